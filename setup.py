@@ -98,7 +98,7 @@ else:
     # the display so module
     x11 = Extension('kaa.display._X11module',
                     [ 'src/x11.c', 'src/x11display.c', 'src/x11window.c',
-                      'src/common.c' ],
+                      'src/x11shape.c', 'src/colorlut.c', 'src/common.c' ],
                     libraries = ['rt'])
 
     config.define('HAVE_X11')
@@ -134,7 +134,11 @@ else:
 
 if get_library('imlib2') and not 'imlib2' in disable:
     # the framebuffer so module
-    fb = Extension('kaa.display._FBmodule', [ 'src/fb.c', 'src/common.c'])
+    fb = Extension('kaa.display._FBmodule', [ 'src/fb.c', 'src/fbblit.c', 'src/fbdamage.c',
+                                               'src/fbscale.c', 'src/fbinput.c',
+                                               'src/fbcapture.c', 'src/colorlut.c',
+                                               'src/common.c'],
+                   libraries = ['pthread', 'rt'])
     fb.add_library('imlib2')
     print "+ Framebuffer (imlib2)"
     modules.append(fb)
@@ -145,7 +149,9 @@ else:
 if pygame and get_library('sdl') and get_library('imlib2') and not 'imlib2' in disable:
 
     # pygame module
-    sdl = Extension('kaa.display._SDLmodule', ['src/sdl.c', 'src/common.c'])
+    sdl = Extension('kaa.display._SDLmodule', ['src/sdl.c', 'src/fbblit.c', 'src/colorlut.c',
+                                               'src/common.c'],
+                    libraries = ['pthread'])
     sdl.add_library('imlib2')
     sdl.add_library('sdl')
     sdl.include_dirs.append(pygame)
@@ -155,9 +161,9 @@ else:
     print "- SDL"
 
 
-requires_common       = 'python-kaa-base >= 0.1.2, pygame >= 1.6.0, python-kaa-imlib2 >= 0.2.0,' \
+requires_common       = 'python-kaa-base >= 0.1.2, pygame >= 1.8.0, python-kaa-imlib2 >= 0.2.0,' \
                         'imlib2 >= 1.2.1'
-build_requires_common = 'python-kaa-base >= 0.1.2, pygame-devel >= 1.6.0, python-kaa-imlib2 >= 0.2.0,' \
+build_requires_common = 'python-kaa-base >= 0.1.2, pygame-devel >= 1.8.0, python-kaa-imlib2 >= 0.2.0,' \
                         'imlib2-devel >= 1.2.1'
 
 setup(
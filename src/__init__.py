@@ -30,6 +30,8 @@
 # -----------------------------------------------------------------------------
 
 from version import VERSION
+from colorlut import color_lut
+from pixels import PixelBuffer
 
 displays = []
 
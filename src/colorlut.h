@@ -0,0 +1,51 @@
+/*
+ * ----------------------------------------------------------------------------
+ * colorlut.h - Per channel colour lookup tables
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+
+#ifndef _COLORLUT_H_
+#define _COLORLUT_H_
+
+#include <stdint.h>
+
+// Per channel lookup table, e.g. for gamma or colour range correction of
+// an output.  The entries are already shifted into place in an ARGB32
+// pixel, so a pixel is alpha | red[r] | green[g] | blue[b].
+typedef struct _ColorLUT {
+    uint32_t red[256], green[256], blue[256];
+} ColorLUT;
+
+#ifdef Py_PYTHON_H
+int colorlut_from_pyobject(PyObject *obj, ColorLUT **lut);
+#endif
+void colorlut_apply(const ColorLUT *lut, uint32_t *dst, const uint32_t *src, int n);
+
+#endif
@@ -0,0 +1,56 @@
+# -*- coding: iso-8859-1 -*-
+# -----------------------------------------------------------------------------
+# colorlut.py - Colour lookup tables for gamma and range correction
+# -----------------------------------------------------------------------------
+# $Id$
+#
+# -----------------------------------------------------------------------------
+# kaa.display - Generic Display Module
+# Copyright (C) 2006-2008 Dirk Meyer, Jason Tackaberry
+#
+# First Edition: Dirk Meyer <dmeyer@tzi.de>
+# Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+#
+# Please see the file AUTHORS for a complete list of authors.
+#
+# This library is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License version
+# 2.1 as published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+# 02110-1301 USA
+#
+# -----------------------------------------------------------------------------
+
+__all__ = [ 'color_lut' ]
+
+
+def color_lut(gamma=1.0, limited_range=False):
+    """
+    Return (red, green, blue) tables for set_color_lut() of a framebuffer or
+    X11 window.
+
+    @param gamma: Gamma applied to each channel, either one value or a
+                  (red, green, blue) tuple.  Values above 1 brighten.
+    @param limited_range: Map full range 0-255 to the limited 16-235 range
+                          used by video encoders.
+    """
+    if not isinstance(gamma, (tuple, list)):
+        gamma = gamma, gamma, gamma
+    tables = []
+    for g in gamma:
+        table = []
+        for i in range(256):
+            v = 255.0 * (i / 255.0) ** (1.0 / g)
+            if limited_range:
+                v = 16 + v * 219 / 255
+            table.append(chr(int(v + 0.5)))
+        tables.append(''.join(table))
+    return tuple(tables)
@@ -30,6 +30,7 @@
  */
 
 #include <Python.h>
+#include "common.h"
 
 void **get_module_api(char *module)
 {
@@ -48,3 +49,74 @@ void **get_module_api(char *module)
 }
 
 
+
+
+/* Fill in buf from a (buffer, width, height, stride, format) tuple, with
+ * the stride in bytes and format 'BGRA' or 'BGRX', the byte order of
+ * 32-bit ARGB on little endian machines as in kaa.imlib2.  The X byte of
+ * BGRX is passed on as it is where pixels are copied unconverted.  The
+ * pixels are not copied; the buffer is held until pixel_buffer_release(),
+ * so it can't be resized or freed meanwhile.  Objects with only the old
+ * buffer protocol, like mmap in Python 2, are accepted too; they are only
+ * kept alive, so they must not be resized or closed while drawing.
+ * Returns 0 and sets an exception on errors; releasing buf is harmless
+ * then.
+ */
+int pixel_buffer_from_pyobject(PyObject *obj, PixelBuffer *buf)
+{
+    PyObject *buffer;
+    char *format;
+    int stride;
+
+    buf->view.obj = NULL;
+    if (!PyArg_ParseTuple(obj, "Oiiis", &buffer, &buf->width, &buf->height, &stride,
+                          &format))
+        return 0;
+
+    if (!strcmp(format, "BGRA"))
+        buf->has_alpha = 1;
+    else if (!strcmp(format, "BGRX"))
+        buf->has_alpha = 0;
+    else {
+        PyErr_Format(PyExc_ValueError, "unsupported pixel format %s", format);
+        return 0;
+    }
+    if (buf->width <= 0 || buf->height <= 0 || stride < buf->width * 4 || stride % 4) {
+        PyErr_Format(PyExc_ValueError, "invalid size or stride");
+        return 0;
+    }
+
+    if (PyObject_CheckBuffer(buffer)) {
+        if (PyObject_GetBuffer(buffer, &buf->view, PyBUF_SIMPLE) < 0) {
+            buf->view.obj = NULL;
+            return 0;
+        }
+    } else {
+        const void *data;
+        Py_ssize_t len;
+
+        if (PyObject_AsReadBuffer(buffer, &data, &len) < 0)
+            return 0;
+        // Only takes a reference to buffer.
+        PyBuffer_FillInfo(&buf->view, buffer, (void *)data, len, 1, PyBUF_SIMPLE);
+    }
+    if (buf->view.len < (Py_ssize_t)stride * (buf->height - 1) + buf->width * 4) {
+        PyErr_Format(PyExc_ValueError, "buffer too small for %dx%d pixels", buf->width,
+                     buf->height);
+        PyBuffer_Release(&buf->view);
+        return 0;
+    }
+    if ((uintptr_t)buf->view.buf % 4) {
+        PyErr_Format(PyExc_ValueError, "pixel buffer must be 4 byte aligned");
+        PyBuffer_Release(&buf->view);
+        return 0;
+    }
+    buf->pixels = buf->view.buf;
+    buf->stride = stride / 4;
+    return 1;
+}
+
+void pixel_buffer_release(PixelBuffer *buf)
+{
+    PyBuffer_Release(&buf->view);
+}
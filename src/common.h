@@ -29,8 +29,23 @@
  * ----------------------------------------------------------------------------
  */
 
+#include <stdint.h>
+
 void **get_module_api(char *module);
 
+// 32-bit ARGB pixels read in place from any object with the buffer
+// protocol, given as a (buffer, width, height, stride, format) tuple.
+typedef struct {
+    const uint32_t *pixels;
+    int width, height;
+    int stride;             // pixels from one line to the next
+    int has_alpha;
+    Py_buffer view;         // keeps the pixels from being freed or moved
+} PixelBuffer;
+
+int pixel_buffer_from_pyobject(PyObject *obj, PixelBuffer *buf);
+void pixel_buffer_release(PixelBuffer *buf);
+
 #define CHECK_IMAGE_PYOBJECT \
     if (!Image_PyObject_Type) { \
         PyErr_Format(PyExc_SystemError, "kaa.imlib2 is required but is not available."); \
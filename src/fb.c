@@ -32,8 +32,11 @@
 #include <Python.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -42,9 +45,12 @@
 #include <linux/vt.h>
 #include <linux/fb.h>
 #include <errno.h>
+#include <time.h>
 
 #include "config.h"
 #include "common.h"
+#include "fb.h"
+#include "fbinput.h"
 
 
 #define X_DISPLAY_MISSING
@@ -53,206 +59,1283 @@ Imlib_Image *(*imlib_image_from_pyobject)(PyObject *pyimg);
 PyTypeObject *Image_PyObject_Type = NULL;
 
 
-int fb_fd = 0;
-int *fb_mem = 0;
+static double fb_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
-static struct fb_var_screeninfo fb_var;
-static struct fb_var_screeninfo fb_var_save;
-static struct fb_fix_screeninfo fb_fix;
+/* Take the lock of the framebuffer.  The thread holding it may be drawing
+ * without the GIL and want it back, so the GIL is released while waiting.
+ * No Python code may run while the lock is held: arguments are parsed
+ * before taking it.
+ */
+static void fb_lock(Framebuffer_PyObject *self)
+{
+    if (pthread_mutex_trylock(&self->lock) == 0)
+        return;
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->lock);
+    Py_END_ALLOW_THREADS
+}
 
-static void tty_disable (void);
-static void tty_enable (void);
+static void fb_unlock(Framebuffer_PyObject *self)
+{
+    pthread_mutex_unlock(&self->lock);
+}
 
-/* Copy from the supplied 32-bit ARGB to the same-structure framebuffer */
-PyObject *fb_update(PyObject *self, PyObject *args)
+/* ioctl() on the device.  A fake device reports the screeninfo it was
+ * created with, takes new offsets and virtual sizes that fit into the
+ * file, and has no vsync.
+ */
+static int fb_ioctl(Framebuffer_PyObject *self, unsigned long request, void *arg)
 {
-    PyObject *pyimg;
-    Imlib_Image *img;
-    unsigned char *pixels;
+    struct fb_var_screeninfo *var = arg;
 
-    CHECK_IMAGE_PYOBJECT
+    if (!self->fake)
+        return ioctl(self->fd, request, arg);
 
-    if (!PyArg_ParseTuple(args, "O!", Image_PyObject_Type, &pyimg)) {
-        PyErr_Format(PyExc_SystemError, "imlib2 image as parameter needed");
-        return NULL;
+    switch (request) {
+    case FBIOGET_FSCREENINFO:
+        *(struct fb_fix_screeninfo *)arg = self->fake_fix;
+        return 0;
+    case FBIOGET_VSCREENINFO:
+        *var = self->fake_var;
+        return 0;
+    case FBIOPUT_VSCREENINFO:
+        if (var->xres != self->fake_var.xres || var->yres != self->fake_var.yres ||
+            var->bits_per_pixel != self->fake_var.bits_per_pixel ||
+            var->xres_virtual != self->fake_var.xres_virtual ||
+            var->yres_virtual * self->fake_fix.line_length > self->fake_fix.smem_len)
+            break;
+        self->fake_var.yres_virtual = var->yres_virtual;
+        /* fall through */
+    case FBIOPAN_DISPLAY:
+        if (var->yoffset + self->fake_var.yres > self->fake_var.yres_virtual)
+            break;
+        self->fake_var.xoffset = var->xoffset;
+        self->fake_var.yoffset = var->yoffset;
+        return 0;
     }
+    errno = EINVAL;
+    return -1;
+}
 
-    img = imlib_image_from_pyobject(pyimg);
-    imlib_context_set_image(img);
-    pixels = (unsigned char *)imlib_image_get_data_for_reading_only();
+/* Create the file for a fake device of the given geometry, with room for
+ * two pages.  Without a path the memory is anonymous.
+ */
+static int fb_open_fake(Framebuffer_PyObject *self, const char *path,
+                        int width, int height, int depth)
+{
+    struct fb_var_screeninfo *var = &self->fake_var;
+    struct fb_fix_screeninfo *fix = &self->fake_fix;
+    char tmpl[] = "/tmp/kaa-fb-XXXXXX";
 
-    memcpy(fb_mem, pixels, imlib_image_get_width() *
-           imlib_image_get_height() * 4);
+    if (width <= 0 || height <= 0 || (depth != 16 && depth != 24 && depth != 32)) {
+        PyErr_Format(PyExc_ValueError, "invalid fake framebuffer %dx%d depth=%d",
+                     width, height, depth);
+        return -1;
+    }
 
-    Py_INCREF(Py_None);
-    return Py_None;
+    memset(var, 0, sizeof(*var));
+    memset(fix, 0, sizeof(*fix));
+    var->xres = var->xres_virtual = width;
+    var->yres = var->yres_virtual = height;
+    var->bits_per_pixel = depth;
+    if (depth == 16) {
+        var->red.offset = 11;
+        var->red.length = 5;
+        var->green.offset = 5;
+        var->green.length = 6;
+        var->blue.length = 5;
+    } else {
+        var->red.offset = 16;
+        var->red.length = 8;
+        var->green.offset = 8;
+        var->green.length = 8;
+        var->blue.length = 8;
+    }
+    strcpy(fix->id, "kaa fake");
+    fix->type = FB_TYPE_PACKED_PIXELS;
+    fix->visual = FB_VISUAL_TRUECOLOR;
+    fix->line_length = width * depth / 8;
+    fix->smem_len = fix->line_length * height * 2;
+
+    if (path)
+        self->fd = open(path, O_RDWR | O_CREAT, 0644);
+    else {
+#ifdef SYS_memfd_create
+        self->fd = syscall(SYS_memfd_create, "kaa-fb", 0);
+        if (self->fd < 0)
+#endif
+        {
+            self->fd = mkstemp(tmpl);
+            if (self->fd >= 0)
+                unlink(tmpl);
+        }
+    }
+    if (self->fd < 0) {
+        PyErr_SetFromErrnoWithFilename(PyExc_IOError, (char *)path);
+        return -1;
+    }
+    if (ftruncate(self->fd, fix->smem_len) != 0) {
+        PyErr_SetFromErrno(PyExc_IOError);
+        close(self->fd);
+        self->fd = -1;
+        return -1;
+    }
+    self->fake = 1;
+    return 0;
+}
+
+/* Switch the console to graphics or back to text mode.  With process
+ * controlled switching this is our console even while another one is
+ * shown; otherwise it is the one in front.
+ */
+static int fb_set_tty_mode(Framebuffer_PyObject *self, int mode)
+{
+    int tty, res;
+
+    if (self->vt_fd >= 0)
+        return ioctl(self->vt_fd, KDSETMODE, mode);
+    if (!self->tty)
+        return 0;
+
+    tty = open(self->tty, O_RDWR);
+    if (tty < 0)
+        return -1;
+    res = ioctl(tty, KDSETMODE, mode);
+    close(tty);
+    return res;
 }
 
+static void fb_set_back_page(Framebuffer_PyObject *self, int page)
+{
+    self->back_page = page;
+    self->surface.mem = self->mem + page * self->var.yres * self->surface.line_length;
+}
 
-PyObject *fb_open(PyObject *self, PyObject *args)
+/* Show the page we have been drawing into.  Returns 1 if it became visible
+ * on the first vblank after the request, 0 if the flip took longer than a
+ * frame and -1 if this is unknown because we don't wait for vsync.
+ */
+static int fb_flip(Framebuffer_PyObject *self)
 {
-    tty_disable ();
+    struct fb_var_screeninfo var = self->var;
+    __u32 crtc = 0;
+    int res, hit = -1;
+    double start = 0, end = 0;
+
+    var.xoffset = 0;
+    var.yoffset = self->back_page * self->var.yres;
+
+    Py_BEGIN_ALLOW_THREADS
+    start = fb_now();
+    res = fb_ioctl(self, FBIOPAN_DISPLAY, &var);
+    if (res == 0 && self->wait_vsync) {
+        if (fb_ioctl(self, FBIO_WAITFORVSYNC, &crtc) == 0)
+            end = fb_now();
+        else
+            self->wait_vsync = 0;
+    }
+    Py_END_ALLOW_THREADS
 
-    fb_fd = open ("/dev/fb0", O_RDWR);
+    if (res != 0)
+        return -1;
+    if (end)
+        hit = end - start <= self->frame_time * 1.1;
+
+    self->var.yoffset = var.yoffset;
+    fb_set_back_page(self, !self->back_page);
+    return hit;
+}
+
+/* Time between two vblanks, for modes that don't tell us their timings. */
+static double fb_measure_frame_time(Framebuffer_PyObject *self)
+{
+    __u32 crtc = 0;
+    double start;
+
+    if (fb_ioctl(self, FBIO_WAITFORVSYNC, &crtc) != 0)
+        return 0;
+    start = fb_now();
+    if (fb_ioctl(self, FBIO_WAITFORVSYNC, &crtc) != 0)
+        return 0;
+    return fb_now() - start;
+}
+
+/* Copy the given rects (x, y, w, h) of the source to the framebuffer, or the
+ * whole source if n_rects is -1.  If scale is set, the source is scaled into
+ * the rect set up with fb_setup_scale and dst_x, dst_y are ignored.
+ */
+static void fb_blit_rects(Framebuffer_PyObject *self, FBSource *src, int *rects,
+                          int n_rects, int dst_x, int dst_y, int scale)
+{
+    Py_BEGIN_ALLOW_THREADS
+    if (scale)
+        fbscale_rects(&self->surface, src, &self->scale, rects, n_rects, self->pool);
+    else
+        fbblit_rects(&self->surface, src, rects, n_rects, dst_x, dst_y, self->pool);
+    Py_END_ALLOW_THREADS
+}
+
+/* Fill the visible area of all pages with black, unless another console
+ * is shown; vt_acquire clears the screen then.
+ */
+static void fb_clear(Framebuffer_PyObject *self)
+{
+    FBSurface *surface = &self->surface;
+    unsigned char *page = surface->mem;
+    int y, pages;
+
+    if (!self->vt_active)
+        return;
+
+    for (pages = self->double_buffer ? 2 : 1; pages > 0; pages--) {
+        for (y = 0; y < surface->height; y++)
+            memset(page + y * surface->line_length, 0,
+                   surface->width * surface->bytes_per_pixel);
+        page = self->mem + !self->back_page * self->var.yres * surface->line_length;
+    }
+}
+
+/* Fit an image of the given size into the screen minus the overscan margins,
+ * centered and with its aspect ratio kept if keep_aspect is set.  When the
+ * rect changes the bars around it are cleared.  Returns like fbscale_setup.
+ */
+static int fb_setup_scale(Framebuffer_PyObject *self, int width, int height)
+{
+    int x, y, w, h, res;
+
+    x = self->overscan[0];
+    y = self->overscan[1];
+    w = FBSURFACE_WIDTH(&self->surface) - self->overscan[0] - self->overscan[2];
+    h = FBSURFACE_HEIGHT(&self->surface) - self->overscan[1] - self->overscan[3];
+    if (self->keep_aspect && w > 0 && h > 0) {
+        if ((long long)width * h > (long long)height * w) {
+            y += (h - (int)((long long)height * w / width)) / 2;
+            h = (long long)height * w / width;
+        } else {
+            x += (w - (int)((long long)width * h / height)) / 2;
+            w = (long long)width * h / height;
+        }
+    }
+    res = fbscale_setup(&self->scale, self->scale_filter, width, height, x, y, w, h);
+    if (res > 0)
+        fb_clear(self);
+    return res;
+}
+
+/* Put anonymous memory in place of the device, so buffers and images
+ * handed out stay valid but no longer reach the screen.
+ */
+static int fb_unmap_device(Framebuffer_PyObject *self)
+{
+    void *mem = mmap(self->mem, self->mem_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    return mem == MAP_FAILED ? -1 : 0;
+}
+
+/* Map the device again at the same address. */
+static int fb_map_device(Framebuffer_PyObject *self)
+{
+    void *mem = mmap(self->mem, self->mem_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_FIXED, self->fd, 0);
+    return mem == MAP_FAILED ? -1 : 0;
+}
+
+/* Unmap and close the device and restore its mode and the console.  The
+ * address is kept until dealloc, since buffers of the framebuffer may
+ * still point into it.
+ */
+static void fb_close(Framebuffer_PyObject *self)
+{
+    if (self->mem) {
+        if (fb_unmap_device(self) == 0)
+            self->detached = self->mem;
+        else
+            munmap(self->mem, self->mem_size);
+        self->mem = NULL;
+        if (!self->fake) {
+            fb_set_tty_mode(self, KD_TEXT);
+            // The mode belongs to the other console while it is shown.
+            if (self->vt_active)
+                ioctl(self->fd, FBIOPUT_VSCREENINFO, &self->var_save);
+        }
+    }
+    if (self->vt_fd >= 0) {
+        ioctl(self->vt_fd, VT_SETMODE, &self->vt_save);
+        close(self->vt_fd);
+        self->vt_fd = -1;
+    }
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+    free(self->prev_rects);
+    self->prev_rects = NULL;
+    self->double_buffer = 0;
+}
+
+
+PyObject *
+Framebuffer_PyObject__new(PyTypeObject *type, PyObject * args,
+                          PyObject * kwargs)
+{
+    static char *kwlist[] = { "device", "mode", "double_buffer", "wait_vsync", "depth",
+                              "dither", "tty", "fake", "threads", "detect_damage",
+                              "rotation", NULL };
+    Framebuffer_PyObject *self;
+    PyObject *mode = Py_None, *fake = Py_None;
+    char *device = NULL, *tty = NULL;
+    int double_buffer = 0, wait_vsync = 1, depth = 0, dither = 0, fake_w, fake_h;
+    int threads = 0, detect_damage = 0, rotation = 0;
 
-    if (fb_fd < 0) {
-        perror ("open");
-        PyErr_Format(PyExc_SystemError, "unable to open device");
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|zOiiiizOiii", kwlist, &device, &mode,
+                                     &double_buffer, &wait_vsync, &depth, &dither,
+                                     &tty, &fake, &threads, &detect_damage, &rotation))
         return NULL;
+
+    if (rotation % 90 || rotation < 0 || rotation > 270) {
+        PyErr_Format(PyExc_ValueError, "rotation must be 0, 90, 180 or 270");
+        return NULL;
+    }
+
+    if (fake == Py_None && !device) {
+        PyErr_Format(PyExc_ValueError, "device needed");
+        return NULL;
+    }
+
+    self = (Framebuffer_PyObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    pthread_mutex_init(&self->lock, NULL);
+    self->fd = -1;
+    self->vt_fd = -1;
+    self->vt_active = 1;
+    self->n_prev_rects = -1;
+
+    if (fake != Py_None) {
+        if (!PyArg_ParseTuple(fake, "ii", &fake_w, &fake_h) ||
+            fb_open_fake(self, device, fake_w, fake_h, depth ? depth : 32) < 0) {
+            Py_DECREF(self);
+            return NULL;
+        }
+    } else {
+        self->fd = open(device, O_RDWR);
+        if (self->fd < 0) {
+            PyErr_Format(PyExc_SystemError, "unable to open device %s: %s", device,
+                         strerror(errno));
+            Py_DECREF(self);
+            return NULL;
+        }
+        if (tty)
+            self->tty = strdup(tty);
     }
 
-    if (ioctl (fb_fd, FBIOGET_FSCREENINFO, &fb_fix) != 0) {
-        perror ("ioctl");
-        close (fb_fd);
+    if (fb_ioctl(self, FBIOGET_FSCREENINFO, &self->fix) != 0) {
         PyErr_Format(PyExc_SystemError, "unable to get screeninfo");
+        Py_DECREF(self);
         return NULL;
     }
 
-    if (ioctl (fb_fd, FBIOGET_VSCREENINFO, &fb_var) != 0) {
-        perror ("ioctl");
-        close (fb_fd);
+    if (fb_ioctl(self, FBIOGET_VSCREENINFO, &self->var) != 0) {
         PyErr_Format(PyExc_SystemError, "unable to get screen vars");
+        Py_DECREF(self);
         return NULL;
     }
 
     /* save settings to restore at the end */
-    ioctl (fb_fd, FBIOGET_VSCREENINFO, &fb_var_save);
+    self->var_save = self->var;
 
-    /* OK, this is ugly but we need this. */
-    fb_var.bits_per_pixel = 32;
+    /* Keep the depth of the console unless asked for another one; anything
+     * but 32 bits is converted on update. */
+    if (depth)
+        self->var.bits_per_pixel = depth;
 
     /* try to set fbsettings */
-    PyArg_ParseTuple(args, "|(iiiiiiiiiiiiiiiii)", &fb_var.xres, &fb_var.yres,
-                     &fb_var.xres_virtual, &fb_var.yres_virtual,
-                     &fb_var.xoffset, &fb_var.yoffset, &fb_var.height,
-                     &fb_var.height, &fb_var.pixclock, &fb_var.left_margin,
-                     &fb_var.right_margin, &fb_var.upper_margin,
-                     &fb_var.lower_margin, &fb_var.vsync_len,
-                     &fb_var.hsync_len,
-                     &fb_var.sync, &fb_var.vmode);
-
-    if (ioctl (fb_fd, FBIOPUT_VSCREENINFO, &fb_var) != 0) {
-        perror ("ioctl");
-        close (fb_fd);
-        PyErr_Format(PyExc_SystemError, "unable to set screen vars");
+    if (mode != Py_None &&
+        !PyArg_ParseTuple(mode, "iiiiiiiiiiiiiiiii", &self->var.xres, &self->var.yres,
+                          &self->var.xres_virtual, &self->var.yres_virtual,
+                          &self->var.xoffset, &self->var.yoffset, &self->var.height,
+                          &self->var.height, &self->var.pixclock, &self->var.left_margin,
+                          &self->var.right_margin, &self->var.upper_margin,
+                          &self->var.lower_margin, &self->var.vsync_len,
+                          &self->var.hsync_len,
+                          &self->var.sync, &self->var.vmode)) {
+        Py_DECREF(self);
         return NULL;
+    }
 
+    /* room for two pages on top of each other */
+    if (double_buffer) {
+        if (self->var.yres_virtual < 2 * self->var.yres)
+            self->var.yres_virtual = 2 * self->var.yres;
+        self->var.xoffset = self->var.yoffset = 0;
     }
 
-    ioctl (fb_fd, FBIOGET_VSCREENINFO, &fb_var);
+    if (double_buffer && fb_ioctl(self, FBIOPUT_VSCREENINFO, &self->var) != 0) {
+        /* maybe the driver doesn't have the memory for two pages */
+        self->var.yres_virtual = self->var_save.yres_virtual;
+        double_buffer = 0;
+    }
 
-    if (fb_var.bits_per_pixel != 32) {
-        ioctl (fb_fd, FBIOPUT_VSCREENINFO, &fb_var_save);
-        close (fb_fd);
-        PyErr_Format(PyExc_SystemError, "unable to set depth=32");
+    if (!double_buffer && fb_ioctl(self, FBIOPUT_VSCREENINFO, &self->var) != 0) {
+        PyErr_Format(PyExc_SystemError, "unable to set screen vars");
+        Py_DECREF(self);
         return NULL;
     }
 
-    fb_mem = mmap ((void *) NULL, fb_var.xres * fb_var.yres * \
-                   fb_var.bits_per_pixel / 8,
-                   PROT_READ | PROT_WRITE, MAP_SHARED, fb_fd, 0);
+    fb_ioctl(self, FBIOGET_VSCREENINFO, &self->var);
+    /* line_length may change with the mode */
+    fb_ioctl(self, FBIOGET_FSCREENINFO, &self->fix);
+
+    self->surface.bytes_per_pixel = (self->var.bits_per_pixel + 7) / 8;
+    self->surface.red.offset = self->var.red.offset;
+    self->surface.red.length = self->var.red.length;
+    self->surface.green.offset = self->var.green.offset;
+    self->surface.green.length = self->var.green.length;
+    self->surface.blue.offset = self->var.blue.offset;
+    self->surface.blue.length = self->var.blue.length;
+    self->surface.transp.offset = self->var.transp.offset;
+    self->surface.transp.length = self->var.transp.length;
+    self->surface.dither = dither;
+    self->surface.rotation = rotation / 90;
+    self->surface.uncached = !self->fake;
 
-    if (fb_mem == MAP_FAILED) {
-        perror ("mmap");
-        ioctl (fb_fd, FBIOPUT_VSCREENINFO, &fb_var_save);
-        close (fb_fd);
+    if ((depth && self->var.bits_per_pixel != depth) || !fbblit_setup(&self->surface) ||
+        (self->fix.visual != FB_VISUAL_TRUECOLOR &&
+         self->fix.visual != FB_VISUAL_DIRECTCOLOR)) {
+        fb_ioctl(self, FBIOPUT_VSCREENINFO, &self->var_save);
+        PyErr_Format(PyExc_SystemError, "unsupported depth=%d", self->var.bits_per_pixel);
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    /* Lines may be padded, and the memory covers the whole virtual screen.
+     * Some drivers don't fill in line_length or smem_len. */
+    self->surface.line_length = self->fix.line_length;
+    if (!self->surface.line_length)
+        self->surface.line_length = self->var.xres_virtual * self->surface.bytes_per_pixel;
+    self->mem_size = self->fix.smem_len;
+    if (!self->mem_size)
+        self->mem_size = self->surface.line_length * self->var.yres_virtual;
+
+    self->mem = mmap((void *) NULL, self->mem_size,
+                     PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+
+    if (self->mem == MAP_FAILED) {
+        self->mem = NULL;
+        fb_ioctl(self, FBIOPUT_VSCREENINFO, &self->var_save);
         PyErr_Format(PyExc_SystemError, "unable to get memory");
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    /* Draw into the part of the virtual screen that is visible */
+    self->surface.mem = self->mem + self->var.yoffset * self->surface.line_length +
+                        self->var.xoffset * self->surface.bytes_per_pixel;
+    self->surface.width = self->var.xres;
+    self->surface.height = self->var.yres;
+
+    /* Double buffering needs two pages in the mapping and a driver that can
+     * pan; otherwise fall back to a single buffer. */
+    if (double_buffer && self->var.yres_virtual >= 2 * self->var.yres &&
+        self->mem_size >= 2 * self->var.yres * self->surface.line_length) {
+        self->var.xoffset = self->var.yoffset = 0;
+        if (fb_ioctl(self, FBIOPAN_DISPLAY, &self->var) == 0) {
+            self->double_buffer = 1;
+            fb_set_back_page(self, 1);
+        }
+    }
+    self->wait_vsync = self->double_buffer && wait_vsync;
+    if (self->wait_vsync) {
+        /* frame time from the mode timings; pixclock is in picoseconds */
+        self->frame_time = (double)self->var.pixclock * 1e-12 *
+            (self->var.xres + self->var.left_margin + self->var.right_margin +
+             self->var.hsync_len) *
+            (self->var.yres + self->var.upper_margin + self->var.lower_margin +
+             self->var.vsync_len);
+        if (!self->frame_time)
+            self->frame_time = fb_measure_frame_time(self);
+        if (!self->frame_time)
+            self->wait_vsync = 0;
+    }
+
+    if (fb_set_tty_mode(self, KD_GRAPHICS) != 0) {
+        PyErr_Format(PyExc_SystemError, "unable to set graphics mode for %s: %s",
+                     self->tty, strerror(errno));
+        free(self->tty);
+        self->tty = NULL;
+        Py_DECREF(self);
+        return NULL;
+    }
+
+    self->pool = fbblit_pool_new(threads);
+    self->detect_damage = detect_damage;
+    return (PyObject *)self;
+}
+
+
+void
+Framebuffer_PyObject__dealloc(Framebuffer_PyObject * self)
+{
+    fb_close(self);
+    if (self->detached)
+        munmap(self->detached, self->mem_size);
+    fbblit_pool_free(self->pool);
+    fbdamage_free(&self->damage);
+    fbscale_free(&self->scale);
+    fbcapture_free(&self->capture);
+    free(self->lut);
+    free(self->tty);
+    pthread_mutex_destroy(&self->lock);
+    self->ob_type->tp_free((PyObject*)self);
+}
+
+
+/* The pixels of an imlib2 image or of a (buffer, width, height, stride,
+ * format) tuple (see pixel_buffer_from_pyobject), read in place.  buf holds
+ * the buffer of a tuple and must be released with pixel_buffer_release()
+ * when done, also if this fails.  Returns 0 and sets an exception for other
+ * objects.
+ */
+static int fb_source_from_pyobject(PyObject *obj, FBSource *src, PixelBuffer *buf)
+{
+    buf->view.obj = NULL;
+    if (PyTuple_Check(obj)) {
+        if (!pixel_buffer_from_pyobject(obj, buf))
+            return 0;
+        src->pixels = buf->pixels;
+        src->width = buf->width;
+        src->height = buf->height;
+        src->stride = buf->stride;
+        return 1;
+    }
+    if (!Image_PyObject_Type) {
+        PyErr_Format(PyExc_SystemError, "kaa.imlib2 is required but is not available.");
+        return 0;
+    }
+    if (!PyObject_TypeCheck(obj, Image_PyObject_Type)) {
+        PyErr_Format(PyExc_SystemError, "imlib2 image or pixel buffer as parameter needed");
+        return 0;
+    }
+    imlib_context_set_image(imlib_image_from_pyobject(obj));
+    src->pixels = imlib_image_get_data_for_reading_only();
+    src->width = src->stride = imlib_image_get_width();
+    src->height = imlib_image_get_height();
+    return 1;
+}
+
+
+/* Copy from the supplied 32-bit ARGB to the framebuffer, converting to its
+ * depth if it isn't 32 bits.  The image may be an imlib2 image or a pixel
+ * buffer tuple (see fb_source_from_pyobject), read in place.  It may have
+ * any size and is placed at the given (x, y) position, clipped to the
+ * screen.  If a list of dirty rectangles ((x, y), (w, h)) in image
+ * coordinates is given, only those areas are copied.
+ *
+ * If the image is None, the frame has been drawn in place (see buffer) and
+ * the rects only matter for double buffering.
+ *
+ * With damage detection, a full update only copies the 64x64 tiles of the
+ * image that differ from the last one (see fbdamage.c).
+ *
+ * With scaling enabled (see set_scaling), the image is scaled to the screen
+ * instead and the position is ignored.  A colour table (see set_color_lut)
+ * is applied on the way.
+ *
+ * When double buffering, the hidden page is drawn and then shown.  Returns
+ * whether the flip hit its vblank (see fb_flip), or None.
+ *
+ * Nothing is done while another console is shown (see vt_process).
+ */
+static PyObject *fb_update(Framebuffer_PyObject *self, FBSource *src, int *rects,
+                           int n_rects, int dst_x, int dst_y);
+
+PyObject *
+Framebuffer_PyObject__update(Framebuffer_PyObject * self, PyObject * args)
+{
+    PyObject *pyimg, *pyrects = Py_None, *seq, *res;
+    PixelBuffer buf;
+    FBSource src;
+    int n_rects = -1, i, *rects = NULL, area = 0, dst_x = 0, dst_y = 0;
+
+    if (!PyArg_ParseTuple(args, "O|O(ii)", &pyimg, &pyrects, &dst_x, &dst_y))
+        return NULL;
+
+    if (pyimg == Py_None) {
+        buf.view.obj = NULL;
+        src.pixels = NULL;
+        src.width = self->surface.width;
+        src.height = self->surface.height;
+    } else if (!fb_source_from_pyobject(pyimg, &src, &buf)) {
+        pixel_buffer_release(&buf);
+        return NULL;
+    }
+
+    if (pyrects != Py_None) {
+        seq = PySequence_Fast(pyrects, "rectangles must be a sequence");
+        if (!seq) {
+            pixel_buffer_release(&buf);
+            return NULL;
+        }
+        n_rects = PySequence_Fast_GET_SIZE(seq);
+        rects = malloc(sizeof(int) * 4 * (n_rects ? n_rects : 1));
+        if (!rects) {
+            Py_DECREF(seq);
+            pixel_buffer_release(&buf);
+            return PyErr_NoMemory();
+        }
+        for (i = 0; i < n_rects; i++) {
+            if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "(ii)(ii)", &rects[i * 4],
+                                  &rects[i * 4 + 1], &rects[i * 4 + 2], &rects[i * 4 + 3])) {
+                free(rects);
+                Py_DECREF(seq);
+                pixel_buffer_release(&buf);
+                return NULL;
+            }
+            area += rects[i * 4 + 2] * rects[i * 4 + 3];
+        }
+        Py_DECREF(seq);
+
+        if (area >= src.width * src.height) {
+            // Cheaper to copy everything than to copy overlapping areas twice.
+            free(rects);
+            rects = NULL;
+            n_rects = -1;
+        }
+    }
+
+    fb_lock(self);
+    res = fb_update(self, &src, rects, n_rects, dst_x, dst_y);
+    fb_unlock(self);
+    pixel_buffer_release(&buf);
+    return res;
+}
+
+/* The part of update that runs with the lock held.  Takes over rects. */
+static PyObject *fb_update(Framebuffer_PyObject *self, FBSource *srcp, int *rects,
+                           int n_rects, int dst_x, int dst_y)
+{
+    FBSource src = *srcp;
+    int hit, scale = 0;
+
+    if (!self->mem) {
+        free(rects);
+        PyErr_Format(PyExc_SystemError, "framebuffer not open");
+        return NULL;
+    }
+
+    if (!self->vt_active) {
+        // Another console owns the screen.
+        free(rects);
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    if (src.pixels && self->scale_filter != FBSCALE_NONE) {
+        switch (fb_setup_scale(self, src.width, src.height)) {
+        case -1:
+            free(rects);
+            PyErr_Format(PyExc_SystemError, "unable to scale %dx%d image", src.width,
+                         src.height);
+            return NULL;
+        case 1:
+            // New size or rect: everything has to be drawn again.
+            free(rects);
+            rects = NULL;
+            n_rects = -1;
+            self->n_prev_rects = -1;
+            fbdamage_reset(&self->damage);
+        }
+        if (self->scale.dst_w == src.width && self->scale.dst_h == src.height) {
+            // Fits already, a plain copy is faster.
+            dst_x = self->scale.dst_x;
+            dst_y = self->scale.dst_y;
+        } else
+            scale = 1;
+    }
+
+    if (self->detect_damage) {
+        if (!src.pixels)
+            fbdamage_reset(&self->damage);
+        else if (n_rects >= 0)
+            fbdamage_invalidate(&self->damage, rects, n_rects);
+        else {
+            n_rects = fbdamage_detect(&self->damage, &src, dst_x, dst_y, &rects);
+            if (n_rects == 0) {
+                // Nothing to show.  The hidden page still lacks prev_rects.
+                free(rects);
+                Py_INCREF(Py_None);
+                return Py_None;
+            }
+        }
+    }
+
+    if (!self->double_buffer) {
+        if (src.pixels)
+            fb_blit_rects(self, &src, rects, n_rects, dst_x, dst_y, scale);
+        free(rects);
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+
+    if (!src.pixels) {
+        /* Shown page and hidden page must be the same again after the flip,
+         * so copy what was drawn over to the new hidden page.  Nothing can
+         * be drawn into a rotated one or one with a colour table (see
+         * buffer). */
+        hit = fb_flip(self);
+        src.pixels = (uint32_t *)(self->mem + !self->back_page * self->var.yres *
+                                  self->surface.line_length);
+        src.stride = self->surface.line_length / 4;
+        if (self->surface.rotation == FBBLIT_ROTATE_0 && !self->lut)
+            fb_blit_rects(self, &src, rects, n_rects, 0, 0, 0);
+        free(rects);
+        /* in case the next frame comes from an image again */
+        self->n_prev_rects = -1;
+        if (hit < 0) {
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+        return PyBool_FromLong(hit);
+    }
+
+    // This page last received the frame before the previous one.
+    if (n_rects < 0 || self->n_prev_rects < 0)
+        fb_blit_rects(self, &src, NULL, -1, dst_x, dst_y, scale);
+    else {
+        fb_blit_rects(self, &src, rects, n_rects, dst_x, dst_y, scale);
+        fb_blit_rects(self, &src, self->prev_rects, self->n_prev_rects, dst_x, dst_y, scale);
+    }
+    free(self->prev_rects);
+    self->prev_rects = rects;
+    self->n_prev_rects = n_rects;
+
+    hit = fb_flip(self);
+    if (hit < 0) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyBool_FromLong(hit);
+}
+
+
+/* The memory drawn into as a writable buffer, or None if the framebuffer
+ * doesn't have the layout of an imlib2 image (32-bit ARGB without padding),
+ * is rotated or has a colour table.
+ * When double buffering this is the hidden page, which changes with every
+ * update.  The buffer keeps the framebuffer alive; using it after close
+ * raises an error.  While another console is shown, and for images made
+ * from it after close, writes go to memory that isn't shown.
+ */
+PyObject *
+Framebuffer_PyObject__buffer(Framebuffer_PyObject * self, PyObject * args)
+{
+    if (!self->mem) {
+        PyErr_Format(PyExc_SystemError, "framebuffer not open");
         return NULL;
     }
+    if (!self->surface.native || self->surface.line_length != self->surface.width * 4 ||
+        self->var.xoffset || self->surface.rotation != FBBLIT_ROTATE_0 ||
+        self->surface.lut) {
+        Py_INCREF(Py_None);
+        return Py_None;
+    }
+    return PyBuffer_FromReadWriteObject((PyObject *)self, self->surface.mem - self->mem,
+                                        self->surface.line_length * self->surface.height);
+}
+
+
+PyObject *
+Framebuffer_PyObject__close(Framebuffer_PyObject * self, PyObject * args)
+{
+    fb_lock(self);
+    fb_close(self);
+    fb_unlock(self);
     Py_INCREF(Py_None);
     return Py_None;
 }
 
 
-PyObject *fb_close(PyObject *self, PyObject *args)
+/* Use n threads for large updates; 0 or 1 to do everything in the calling
+ * thread.  Returns the number of threads actually used.
+ */
+PyObject *
+Framebuffer_PyObject__set_threads(Framebuffer_PyObject * self, PyObject * args)
+{
+    int n;
+
+    if (!PyArg_ParseTuple(args, "i", &n))
+        return NULL;
+    fb_lock(self);
+    fbblit_pool_free(self->pool);
+    self->pool = fbblit_pool_new(n);
+    n = fbblit_pool_size(self->pool);
+    fb_unlock(self);
+    return Py_BuildValue("i", n);
+}
+
+
+PyObject *
+Framebuffer_PyObject__set_detect_damage(Framebuffer_PyObject * self, PyObject * args)
 {
-    tty_enable ();
-    ioctl (fb_fd, FBIOPUT_VSCREENINFO, &fb_var_save);
-    close (fb_fd);
+    int detect;
+
+    if (!PyArg_ParseTuple(args, "i", &detect))
+        return NULL;
+    fb_lock(self);
+    self->detect_damage = detect;
+    fbdamage_free(&self->damage);
+    self->damage.frames = self->damage.tiles = self->damage.skipped = 0;
+    fb_unlock(self);
     Py_INCREF(Py_None);
     return Py_None;
 }
 
-PyObject *fb_size(PyObject *self, PyObject *args)
+
+/* Scale images to the screen with the given filter ('nearest' or
+ * 'bilinear'), or place them unscaled if it is None.  The margins
+ * (left, top, right, bottom) are left black, e.g. for TV overscan.  The
+ * next update should be a full one.
+ */
+PyObject *
+Framebuffer_PyObject__set_scaling(Framebuffer_PyObject * self, PyObject * args)
 {
-    return Py_BuildValue("(ii)", fb_var.xres, fb_var.yres);
+    char *filter;
+    int overscan[4] = { 0, 0, 0, 0 }, keep_aspect = 1, i, scale_filter;
+
+    if (!PyArg_ParseTuple(args, "z|(iiii)i", &filter, &overscan[0], &overscan[1],
+                          &overscan[2], &overscan[3], &keep_aspect))
+        return NULL;
+
+    if (!filter)
+        scale_filter = FBSCALE_NONE;
+    else if (!strcmp(filter, "nearest"))
+        scale_filter = FBSCALE_NEAREST;
+    else if (!strcmp(filter, "bilinear"))
+        scale_filter = FBSCALE_BILINEAR;
+    else {
+        PyErr_Format(PyExc_ValueError, "unknown filter %s", filter);
+        return NULL;
+    }
+    fb_lock(self);
+    self->scale_filter = scale_filter;
+    for (i = 0; i < 4; i++)
+        self->overscan[i] = overscan[i] > 0 ? overscan[i] : 0;
+    self->keep_aspect = keep_aspect;
+
+    fbscale_free(&self->scale);
+    if (self->mem)
+        fb_clear(self);
+    self->n_prev_rects = -1;
+    fbdamage_reset(&self->damage);
+    fb_unlock(self);
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
 
-PyObject *fb_depth(PyObject *self, PyObject *args)
+/* Look up every pixel of the following updates in the table given as
+ * (red, green, blue), each a 256 byte string or a list of 256 ints, e.g. for
+ * gamma correction.  None or a table that changes nothing turn it off.  The
+ * next update should be a full one.
+ */
+PyObject *
+Framebuffer_PyObject__set_color_lut(Framebuffer_PyObject * self, PyObject * args)
 {
-    return Py_BuildValue("i", fb_var.bits_per_pixel);
+    PyObject *lut;
+    ColorLUT *new_lut = NULL;
+
+    if (!PyArg_ParseTuple(args, "O", &lut))
+        return NULL;
+    if (colorlut_from_pyobject(lut, &new_lut) < 0)
+        return NULL;
+    fb_lock(self);
+    free(self->lut);
+    self->lut = new_lut;
+    fbblit_set_lut(&self->surface, self->lut);
+    self->n_prev_rects = -1;
+    fbdamage_reset(&self->damage);
+    fb_unlock(self);
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
-PyObject *fb_info(PyObject *self, PyObject *args)
+
+/* Switch away from and back to our console under our control: the kernel
+ * sends relsig when the user wants another console and acqsig when ours is
+ * shown again.  The handlers must call vt_release and vt_acquire.
+ */
+PyObject *
+Framebuffer_PyObject__vt_process(Framebuffer_PyObject * self, PyObject * args)
 {
-    return Py_BuildValue("(iiiiiiiiiiiiiiiii)", fb_var.xres, fb_var.yres,
-                         fb_var.xres_virtual, fb_var.yres_virtual,
-                         fb_var.xoffset, fb_var.yoffset, fb_var.height,
-                         fb_var.height, fb_var.pixclock, fb_var.left_margin,
-                         fb_var.right_margin, fb_var.upper_margin,
-                         fb_var.lower_margin, fb_var.vsync_len,
-                         fb_var.hsync_len,
-                         fb_var.sync, fb_var.vmode);
+    struct vt_mode mode;
+    int relsig, acqsig;
+
+    if (!PyArg_ParseTuple(args, "ii", &relsig, &acqsig))
+        return NULL;
+    if (!self->mem || !self->tty || self->fake) {
+        PyErr_Format(PyExc_SystemError, "no console to switch");
+        return NULL;
+    }
+
+    if (self->vt_fd < 0) {
+        self->vt_fd = open(self->tty, O_RDWR);
+        if (self->vt_fd < 0) {
+            PyErr_Format(PyExc_SystemError, "unable to open %s: %s", self->tty,
+                         strerror(errno));
+            return NULL;
+        }
+        if (ioctl(self->vt_fd, VT_GETMODE, &self->vt_save) != 0) {
+            PyErr_Format(PyExc_SystemError, "unable to get console mode: %s",
+                         strerror(errno));
+            close(self->vt_fd);
+            self->vt_fd = -1;
+            return NULL;
+        }
+    }
+
+    mode = self->vt_save;
+    mode.mode = VT_PROCESS;
+    mode.relsig = relsig;
+    mode.acqsig = acqsig;
+    if (ioctl(self->vt_fd, VT_SETMODE, &mode) != 0) {
+        PyErr_Format(PyExc_SystemError, "unable to set console mode: %s", strerror(errno));
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
-static void tty_disable (void)
+
+/* Stop drawing and allow the switch to another console. */
+PyObject *
+Framebuffer_PyObject__vt_release(Framebuffer_PyObject * self, PyObject * args)
 {
-    int tty;
+    fb_lock(self);
+    if (self->vt_fd >= 0) {
+        self->vt_active = 0;
+        // Images of the buffer must not draw over the other console.
+        if (self->mem)
+            fb_unmap_device(self);
+        ioctl(self->vt_fd, VT_RELDISP, 1);
+    }
+    fb_unlock(self);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/* Our console is shown again.  Its mode is set again in case the other
+ * console changed it and the screen is cleared; the next update should
+ * draw everything.
+ */
+PyObject *
+Framebuffer_PyObject__vt_acquire(Framebuffer_PyObject * self, PyObject * args)
+{
+    fb_lock(self);
+    if (self->vt_fd >= 0) {
+        ioctl(self->vt_fd, VT_RELDISP, VT_ACKACQ);
+        if (self->mem && !self->vt_active && fb_map_device(self) != 0) {
+            fb_unlock(self);
+            PyErr_SetFromErrno(PyExc_SystemError);
+            return NULL;
+        }
+        if (!self->vt_active)
+            fb_ioctl(self, FBIOPUT_VSCREENINFO, &self->var);
+        self->vt_active = 1;
+        self->n_prev_rects = -1;
+        fbdamage_reset(&self->damage);
+        fb_clear(self);
+    }
+    fb_unlock(self);
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/* Capture the shown page, or the given image or pixel buffer, and return
+ * the tiles that changed since the last capture encoded as described in
+ * fbcapture.c.  With full, all tiles are returned.  The page is captured in
+ * the pixel format and orientation of the framebuffer, images as 32-bit
+ * ARGB.  While another console is shown, the page is not read and the last
+ * capture is returned again instead.
+ */
+PyObject *
+Framebuffer_PyObject__capture(Framebuffer_PyObject * self, PyObject * args)
+{
+    PyObject *pyimg = Py_None, *res;
+    PixelBuffer buf;
+    FBSource src;
+    const unsigned char *mem;
+    int full = 0, stride, width, height, bytes_per_pixel, uncached = 0;
+    size_t len;
 
+    if (!PyArg_ParseTuple(args, "|Oi", &pyimg, &full))
+        return NULL;
 
-    tty = open ("/dev/tty0", O_RDWR);
-    if(tty < 0) {
-        perror("Error can't open /dev/tty0");
-        exit (1);
+    buf.view.obj = NULL;
+    if (pyimg != Py_None) {
+        if (!fb_source_from_pyobject(pyimg, &src, &buf)) {
+            pixel_buffer_release(&buf);
+            return NULL;
+        }
+        mem = (const unsigned char *)src.pixels;
+        width = src.width;
+        height = src.height;
+        bytes_per_pixel = 4;
+        stride = src.stride * 4;
+        fb_lock(self);
+    } else {
+        fb_lock(self);
+        if (!self->mem) {
+            fb_unlock(self);
+            PyErr_Format(PyExc_SystemError, "framebuffer not open");
+            return NULL;
+        }
+        mem = self->surface.mem;
+        if (self->double_buffer)
+            mem = self->mem + !self->back_page * self->var.yres * self->surface.line_length;
+        width = self->surface.width;
+        height = self->surface.height;
+        bytes_per_pixel = self->surface.bytes_per_pixel;
+        stride = self->surface.line_length;
+        uncached = !self->fake;
     }
 
-    if(ioctl (tty, KDSETMODE, KD_GRAPHICS) == -1) {
-        perror("Error setting graphics mode for tty");
-        close(tty);
-        exit (1);
+    if (full)
+        fbcapture_reset(&self->capture);
+    if (pyimg == Py_None && !self->vt_active)
+        len = fbcapture_repeat(&self->capture, width, height, bytes_per_pixel);
+    else {
+        Py_BEGIN_ALLOW_THREADS
+        len = fbcapture_tiles(&self->capture, mem, stride, width, height, bytes_per_pixel,
+                              uncached);
+        Py_END_ALLOW_THREADS
     }
+    res = len ? PyString_FromStringAndSize((char *)self->capture.out, len) : PyErr_NoMemory();
+    fb_unlock(self);
+    pixel_buffer_release(&buf);
+    return res;
+}
 
-    close(tty);
 
+/* (frames, tiles, skipped tiles, fraction skipped) since damage detection
+ * was enabled.
+ */
+PyObject *
+Framebuffer_PyObject__get_damage_stats(Framebuffer_PyObject * self, PyObject * args)
+{
+    FBDamage *damage = &self->damage;
+
+    return Py_BuildValue("(KKKd)", damage->frames, damage->tiles, damage->skipped,
+                         damage->tiles ? (double)damage->skipped / damage->tiles : 0.0);
+}
+
+
+PyObject *
+Framebuffer_PyObject__size(Framebuffer_PyObject * self, PyObject * args)
+{
+    return Py_BuildValue("(ii)", FBSURFACE_WIDTH(&self->surface),
+                         FBSURFACE_HEIGHT(&self->surface));
 }
 
 
-static void tty_enable (void)
+PyObject *
+Framebuffer_PyObject__double_buffered(Framebuffer_PyObject * self, PyObject * args)
 {
-    int tty;
+    return PyBool_FromLong(self->double_buffer);
+}
+
+
+PyObject *
+Framebuffer_PyObject__depth(Framebuffer_PyObject * self, PyObject * args)
+{
+    return Py_BuildValue("i", self->var.bits_per_pixel);
+}
+
+
+PyObject *
+Framebuffer_PyObject__info(Framebuffer_PyObject * self, PyObject * args)
+{
+    struct fb_var_screeninfo *var = &self->var;
+
+    return Py_BuildValue("(iiiiiiiiiiiiiiiii)", var->xres, var->yres,
+                         var->xres_virtual, var->yres_virtual,
+                         var->xoffset, var->yoffset, var->height,
+                         var->height, var->pixclock, var->left_margin,
+                         var->right_margin, var->upper_margin,
+                         var->lower_margin, var->vsync_len,
+                         var->hsync_len,
+                         var->sync, var->vmode);
+}
 
-    tty = open ("/dev/tty0", O_RDWR);
-    if(tty < 0) {
-        perror("Error can't open /dev/tty0");
-        exit (1);
+
+PyMethodDef Framebuffer_PyObject_methods[] = {
+    { "close", ( PyCFunction ) Framebuffer_PyObject__close, METH_VARARGS },
+    { "update", ( PyCFunction ) Framebuffer_PyObject__update, METH_VARARGS },
+    { "buffer", ( PyCFunction ) Framebuffer_PyObject__buffer, METH_VARARGS },
+    { "set_threads", ( PyCFunction ) Framebuffer_PyObject__set_threads, METH_VARARGS },
+    { "set_detect_damage", ( PyCFunction ) Framebuffer_PyObject__set_detect_damage, METH_VARARGS },
+    { "set_scaling", ( PyCFunction ) Framebuffer_PyObject__set_scaling, METH_VARARGS },
+    { "set_color_lut", ( PyCFunction ) Framebuffer_PyObject__set_color_lut, METH_VARARGS },
+    { "vt_process", ( PyCFunction ) Framebuffer_PyObject__vt_process, METH_VARARGS },
+    { "vt_release", ( PyCFunction ) Framebuffer_PyObject__vt_release, METH_VARARGS },
+    { "vt_acquire", ( PyCFunction ) Framebuffer_PyObject__vt_acquire, METH_VARARGS },
+    { "capture", ( PyCFunction ) Framebuffer_PyObject__capture, METH_VARARGS },
+    { "get_damage_stats", ( PyCFunction ) Framebuffer_PyObject__get_damage_stats, METH_VARARGS },
+    { "size", ( PyCFunction ) Framebuffer_PyObject__size, METH_VARARGS },
+    { "depth", ( PyCFunction ) Framebuffer_PyObject__depth, METH_VARARGS },
+    { "double_buffered", ( PyCFunction ) Framebuffer_PyObject__double_buffered, METH_VARARGS },
+    { "info", ( PyCFunction ) Framebuffer_PyObject__info, METH_VARARGS },
+    { NULL, NULL }
+};
+
+
+/* The whole mapping, for the buffers returned by buffer(). */
+static Py_ssize_t
+Framebuffer_PyObject__getbuffer(Framebuffer_PyObject * self, Py_ssize_t segment, void **ptr)
+{
+    if (segment != 0) {
+        PyErr_Format(PyExc_SystemError, "accessing non-existent framebuffer segment");
+        return -1;
+    }
+    if (!self->mem) {
+        PyErr_Format(PyExc_SystemError, "framebuffer not open");
+        return -1;
     }
+    *ptr = self->mem;
+    return self->mem_size;
+}
+
+static Py_ssize_t
+Framebuffer_PyObject__getsegcount(Framebuffer_PyObject * self, Py_ssize_t *lenp)
+{
+    if (lenp)
+        *lenp = self->mem ? self->mem_size : 0;
+    return 1;
+}
+
+static PyBufferProcs Framebuffer_PyObject_as_buffer = {
+    (readbufferproc)Framebuffer_PyObject__getbuffer,
+    (writebufferproc)Framebuffer_PyObject__getbuffer,
+    (segcountproc)Framebuffer_PyObject__getsegcount,
+    0,
+};
+
+
+PyTypeObject Framebuffer_PyObject_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                         /*ob_size*/
+    "Framebuffer",             /*tp_name*/
+    sizeof(Framebuffer_PyObject), /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)Framebuffer_PyObject__dealloc, /* tp_dealloc */
+    0,                         /*tp_print*/
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /*tp_compare*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    PyObject_GenericGetAttr,   /*tp_getattro*/
+    PyObject_GenericSetAttr,   /*tp_setattro*/
+    &Framebuffer_PyObject_as_buffer, /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+    "Framebuffer Device Object", /* tp_doc */
+    0,   /* tp_traverse */
+    0,           /* tp_clear */
+    0,                     /* tp_richcompare */
+    0,                     /* tp_weaklistoffset */
+    0,                     /* tp_iter */
+    0,                     /* tp_iternext */
+    Framebuffer_PyObject_methods,            /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    Framebuffer_PyObject__new, /* tp_new */
+};
+
 
-    if(ioctl (tty, KDSETMODE, KD_TEXT) == -1) {
-        perror("Error setting text mode for tty");
-        close(tty);
-        exit (1);
+/* Names of the copy engines the CPU supports, best first, and the one set
+ * with set_copy_engine(), or None if it is chosen per device (see fbblit.c).
+ */
+PyObject *fb_get_copy_engines(PyObject *self, PyObject *args)
+{
+    PyObject *list = PyList_New(0), *name;
+    const char *engine;
+    int i, err;
+
+    if (!list)
+        return NULL;
+    for (i = 0; (engine = fbblit_get_copy_engine(i)); i++) {
+        name = PyString_FromString(engine);
+        if (!name) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        err = PyList_Append(list, name);
+        Py_DECREF(name);
+        if (err < 0) {
+            Py_DECREF(list);
+            return NULL;
+        }
     }
+    return Py_BuildValue("(Nz)", list, fbblit_copy_engine());
+}
 
-    close(tty);
 
+PyObject *fb_set_copy_engine(PyObject *self, PyObject *args)
+{
+    char *name = NULL;
+
+    if (!PyArg_ParseTuple(args, "|z", &name))
+        return NULL;
+    if (!fbblit_set_copy_engine(name)) {
+        PyErr_Format(PyExc_ValueError, "copy engine %s not supported", name);
+        return NULL;
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
 }
 
 
 PyMethodDef fb_methods[] = {
-    { "open", (PyCFunction) fb_open, METH_VARARGS },
-    { "close", (PyCFunction) fb_close, METH_VARARGS },
-    { "update", (PyCFunction) fb_update, METH_VARARGS },
-    { "size", (PyCFunction) fb_size, METH_VARARGS },
-    { "depth", (PyCFunction) fb_depth, METH_VARARGS },
-    { "info", (PyCFunction) fb_info, METH_VARARGS },
+    { "get_copy_engines", (PyCFunction) fb_get_copy_engines, METH_VARARGS },
+    { "set_copy_engine", (PyCFunction) fb_set_copy_engine, METH_VARARGS },
     { NULL }
 };
 
 
 void init_FBmodule(void) {
+    PyObject *m;
     void **imlib2_api_ptrs;
-    (void) Py_InitModule("_FBmodule", fb_methods);
+
+    PyEval_InitThreads();
+    m = Py_InitModule("_FBmodule", fb_methods);
+
+    if (PyType_Ready(&Framebuffer_PyObject_Type) < 0)
+        return;
+    Py_INCREF(&Framebuffer_PyObject_Type);
+    PyModule_AddObject(m, "Framebuffer", (PyObject *)&Framebuffer_PyObject_Type);
+
+    if (PyType_Ready(&FBInput_PyObject_Type) < 0)
+        return;
+    Py_INCREF(&FBInput_PyObject_Type);
+    PyModule_AddObject(m, "Input", (PyObject *)&FBInput_PyObject_Type);
 
     // Import kaa-imlib2's C api
     imlib2_api_ptrs = get_module_api("kaa.imlib2._Imlib2");
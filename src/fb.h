@@ -0,0 +1,104 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fb.h - Framebuffer Display
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FB_H_
+#define _FB_H_
+
+#include <Python.h>
+#include <pthread.h>
+#include <linux/fb.h>
+#include <linux/vt.h>
+#include "fbblit.h"
+#include "fbdamage.h"
+#include "fbscale.h"
+#include "fbcapture.h"
+#include "colorlut.h"
+
+typedef struct {
+    PyObject_HEAD
+
+    // Held by methods using the memory, threads, scaler or colour table,
+    // since drawing is done without the GIL (see fb_lock).
+    pthread_mutex_t lock;
+
+    int fd;
+    unsigned char *mem;     // mapping of the whole device, NULL when closed
+    unsigned char *detached; // mem after close, kept for the buffers handed out
+    size_t mem_size;
+    FBSurface surface;      // the page drawn into
+
+    struct fb_var_screeninfo var, var_save;
+    struct fb_fix_screeninfo fix;
+    char *tty;              // console put into graphics mode, or NULL
+
+    // With process controlled console switching (see vt_process), updates
+    // do nothing while another console is shown.
+    int vt_fd;              // the console, or -1 if the kernel switches
+    int vt_active;
+    struct vt_mode vt_save;
+
+    // A file standing in for the device, with the screeninfo it reports.
+    int fake;
+    struct fb_var_screeninfo fake_var;
+    struct fb_fix_screeninfo fake_fix;
+
+    // Double buffering: we draw into the hidden page and pan to it.  The
+    // rects drawn into the other page for the previous frame are
+    // remembered, because they have to be drawn into this page as well.
+    int double_buffer;
+    int wait_vsync;
+    int back_page;
+    int *prev_rects;
+    int n_prev_rects;       // -1 for everything
+    double frame_time;
+
+    FBBlitPool *pool;       // threads for large updates, or NULL
+
+    // Copy only the tiles that changed on full updates.
+    int detect_damage;
+    FBDamage damage;
+
+    // Images are scaled into the screen minus the overscan margins
+    // (left, top, right, bottom) unless scale_filter is FBSCALE_NONE.
+    int scale_filter;
+    int overscan[4];
+    int keep_aspect;
+    FBScale scale;
+
+    ColorLUT *lut;          // used by surface, NULL for none
+
+    FBCapture capture;      // the last capture, for sending only changes
+} Framebuffer_PyObject;
+
+extern PyTypeObject Framebuffer_PyObject_Type;
+
+#endif
@@ -32,7 +32,16 @@
 __all__ = [ 'PAL_768x576', 'PAL_800x600', 'NTSC_640x480', 'NTSC_768x576',
             'NTSC_800x600', 'Framebuffer' ]
 
+import os
+import glob
+import signal
+import threading
+import weakref
+
+import kaa
+
 import _FBmodule as fb
+from pixels import PixelBuffer
 
 # modelines for tv out
 PAL_768x576  = (768, 576, 768, 576, 0, 0, 0, 0, 38400, 20, 10,
@@ -63,24 +72,140 @@ class _Framebuffer(object):
     The 'mode' argument can either be a size (width, height) matching one of
     the specified framebuffer resolutions, a list for fbset or None. If set to
     None, the current framebuffer size will be used.
+
+    If double_buffer is True, drawing goes to a hidden page which is shown by
+    panning the display on update, waiting for vsync if vsync is True.  If
+    the driver can't do this, a single buffer is used; see double_buffered().
+
+    The framebuffer keeps its current depth unless depth (16, 24 or 32) is
+    given.  Images are converted on update; dither enables ordered dithering
+    for 16 bit RGB565 framebuffers.
+
+    device is the framebuffer device to use.  The console tty is switched to
+    graphics mode while the framebuffer is open; set tty to None to leave
+    it alone.  If fake is a size (width, height), no device is opened and
+    the framebuffer memory is backed by the file device, or by anonymous
+    memory if device is None.  This is meant for testing and benchmarks.
+
+    Large updates are split between the given number of threads; see
+    set_threads().  With detect_damage, updates of the whole image only copy
+    the tiles that changed since the last one; see set_detect_damage().
+
+    rotation turns the picture clockwise by 90, 180 or 270 degrees for
+    panels mounted sideways or upside down.  size() and all positions are
+    those of the rotated screen then.
+
+    With vt_switch, switching to another console is done under our control:
+    while it is shown, updates do nothing and unmap_event is emitted.  When
+    we are back, the screen is cleared and map_event and expose_event ask
+    for a full repaint.  The kernel tells us about switches with SIGUSR1 and
+    SIGUSR2, so this replaces their handlers until the framebuffer is
+    deleted, and the framebuffer must be created in the main thread.
+
+    input is a list of evdev devices to read keyboard and mouse events
+    from, e.g. ['/dev/input/event*']; see add_input().
     """
-    def __init__(self, mode=None):
-        # No signals
-        self.signals = []
-
-        if mode:
-            if len(mode) == 2:
-                mode = globals()['FB_%sx%s' % mode]
-            fb.open(mode)
+    def __init__(self, mode=None, double_buffer=False, vsync=True, depth=None,
+                 dither=False, device='/dev/fb0', tty='/dev/tty0', fake=None,
+                 threads=0, detect_damage=False, rotation=0, vt_switch=False,
+                 input=None):
+        self.signals = kaa.Signals(
+            "key_press_event",     # key pressed
+            "key_release_event",   # key release
+            "button_press_event",  # Button pressed
+            "button_release_event",# Button released
+            "map_event",           # our console is shown again
+            "unmap_event",         # another console is shown
+            "expose_event")        # everything needs to be drawn again
+
+        if mode and len(mode) == 2:
+            mode = globals()['FB_%sx%s' % mode]
+        self._device = device
+        self._fb = fb.Framebuffer(device, mode or None, double_buffer, vsync,
+                                  depth or 0, dither, tty, fake, threads,
+                                  detect_damage, rotation)
+        self._vt_handlers = None
+        self._vt_active = True
+        if vt_switch and tty and fake is None:
+            self._vt_setup()
+        self._input = None
+        self._input_monitors = {}
+        for pattern in input or []:
+            for device in sorted(glob.glob(pattern)) or [pattern]:
+                self.add_input(device)
+
+
+    def _vt_setup(self):
+        """
+        Handle the signals the kernel sends for console switches.
+        """
+        if not isinstance(threading.current_thread(), threading._MainThread):
+            raise RuntimeError('vt_switch needs the framebuffer to be created '
+                               'in the main thread')
+        ref = weakref.ref(self)
+        def handler(signum, frame):
+            if ref():
+                ref()._vt_switch(signum == signal.SIGUSR2)
+        self._vt_handlers = signal.signal(signal.SIGUSR1, handler), \
+                            signal.signal(signal.SIGUSR2, handler)
+        self._fb.vt_process(signal.SIGUSR1, signal.SIGUSR2)
+
+
+    def _vt_switch(self, acquire):
+        """
+        Called from the signal handler when switching away from (acquire is
+        False) or back to our console.  The signals are emitted from the
+        main loop.
+        """
+        self._vt_active = acquire
+        if acquire:
+            self._fb.vt_acquire()
+            region = [((0, 0), self.size())]
+            kaa.OneShotTimer(self.signals['map_event'].emit).start(0)
+            kaa.OneShotTimer(self.signals['expose_event'].emit, region).start(0)
         else:
-            fb.open()
+            self._fb.vt_release()
+            kaa.OneShotTimer(self.signals['unmap_event'].emit).start(0)
+
+
+    def add_input(self, device, grab=False):
+        """
+        Read keyboard and mouse events from an evdev device like
+        /dev/input/event0.  They are emitted as key_press_event,
+        key_release_event, button_press_event and button_release_event
+        with the same arguments as from an X11Window; keys are translated
+        for a US layout.  The mouse pointer is kept inside the screen.
+
+        With grab, the events go to nobody else; note that this includes
+        the console switching keys.  Events arriving while another console
+        is shown are dropped.  Anything but an evdev device, like a pipe or
+        a file with recorded input_event structs, is read until its end.
+        """
+        if self._input is None:
+            self._input = fb.Input(self.size())
+        fd = self._input.open(device, grab)
+        monitor = kaa.WeakIOMonitor(self._read_input, fd)
+        monitor.register(fd)
+        self._input_monitors[fd] = monitor
+
+
+    def _read_input(self, fd):
+        """
+        Emit the events of an input device.
+        """
+        events, alive = self._input.read(fd)
+        if not alive:
+            self._input_monitors.pop(fd).unregister()
+        if self._vt_active:
+            for name, args in events:
+                self.signals[name].emit(*args)
 
 
     def info(self):
         """
         Return some basic informations about the frambuffer.
         """
-        return fb.info()
+        return self._fb.info()
 
 
     def get_id(self):
@@ -88,18 +213,102 @@ class _Framebuffer(object):
         Fake id function that does not return a windows id but returns a
         string that would identify this as framebuffer.
         """
-        return 'fb0'
+        return os.path.basename(self._device or 'fake')
 
 
     def size(self):
         """
         Return the size of the framebuffer.
         """
-        return fb.size()
+        return self._fb.size()
+
+
+    def double_buffered(self):
+        """
+        Return True if page flipping is in use.
+        """
+        return self._fb.double_buffered()
+
+
+    def set_threads(self, threads):
+        """
+        Convert and copy large updates with the given number of threads,
+        including the calling one.  Small updates always stay in the calling
+        thread.  Returns the number of threads that could be started.
+        """
+        return self._fb.set_threads(threads)
+
+
+    def set_detect_damage(self, detect):
+        """
+        Enable or disable damage detection.  When enabled, an update without
+        dirty areas compares the image with the last one in 64x64 tiles and
+        copies only the tiles that changed.  This helps code that does not
+        know what it changed and always updates everything.
+        """
+        self._fb.set_detect_damage(detect)
+
+
+    def set_scaling(self, filter='bilinear', overscan=(0, 0, 0, 0), keep_aspect=True):
+        """
+        Scale images to the screen with the given filter, 'nearest' or
+        'bilinear', or copy them unscaled if filter is None.  overscan is
+        the (left, top, right, bottom) margin left black, for TVs cutting
+        off the edges of the picture.  With keep_aspect the image is
+        centered with black bars instead of being stretched.  The scale
+        tables are kept as long as the image size stays the same.
+        """
+        self._fb.set_scaling(filter, tuple(overscan), keep_aspect)
+
+
+    def set_color_lut(self, lut):
+        """
+        Look up every pixel in the given (red, green, blue) tables on update,
+        for gamma or colour range correction of the output.  Each table is a
+        256 byte string or a list of 256 ints; see kaa.display.color_lut().
+        None or tables that change nothing turn the lookup off.
+        """
+        self._fb.set_color_lut(lut)
+
+
+    def capture(self, full=False):
+        """
+        Return the parts of the screen that changed since the last capture,
+        or everything with full, as a string: a header of five 16 bit little
+        endian numbers (width, height, bytes per pixel, tile size, number of
+        tiles) followed by the tiles, each with its x, y, width and height
+        and then its pixels line by line.  The pixels have the format of
+        the framebuffer, see info() and depth().  Cheap enough for
+        monitoring a few times per second.
+        """
+        return self._fb.capture(None, full)
+
+
+    def get_damage_stats(self):
+        """
+        Return (frames, tiles, skipped, fraction skipped) for the updates
+        since damage detection was enabled.
+        """
+        return self._fb.get_damage_stats()
+
+
+    def depth(self):
+        """
+        Return the depth of the framebuffer in bits per pixel.
+        """
+        return self._fb.depth()
 
 
     def __del__(self):
-        fb.close()
+        for monitor in getattr(self, '_input_monitors', {}).values():
+            monitor.unregister()
+        if getattr(self, '_input', None):
+            self._input.close()
+        if hasattr(self, '_fb'):
+            self._fb.close()
+        if getattr(self, '_vt_handlers', None):
+            signal.signal(signal.SIGUSR1, self._vt_handlers[0])
+            signal.signal(signal.SIGUSR2, self._vt_handlers[1])
 
 
 class Framebuffer(_Framebuffer):
@@ -108,32 +317,178 @@ class Framebuffer(_Framebuffer):
     The 'mode' argument can either be a size (width, height) matching one of
     the specified framebuffer resolutions, a list for fbset or None. If set to
     None, the current framebuffer size will be used.
+
+    Areas changed with blend() are remembered and only those are copied to
+    the framebuffer on the next update().  Code drawing into self.image
+    directly should pass the changed areas to update() or call invalidate().
+
+    If the framebuffer has the memory layout of an imlib2 image (32 bit
+    without padding), self.image is the framebuffer memory itself and
+    nothing needs to be copied.  With a single buffer, drawing is visible
+    at once; when double buffered, self.image is the hidden page and is
+    replaced by the other page on every update().  After set_image() the
+    given image is copied as usual.
     """
-    def __init__(self, mode=None):
-        _Framebuffer.__init__(self, mode)
+    def __init__(self, mode=None, double_buffer=False, vsync=True, depth=None,
+                 dither=False, device='/dev/fb0', tty='/dev/tty0', fake=None,
+                 threads=0, detect_damage=False, rotation=0, vt_switch=False,
+                 input=None):
+        _Framebuffer.__init__(self, mode, double_buffer, vsync, depth, dither,
+                              device, tty, fake, threads, detect_damage,
+                              rotation, vt_switch, input)
+        self.pos = 0, 0
+        # List of dirty ((x, y), (w, h)) areas, or None for everything
+        self._dirty = None
+        self._direct = self._map_image()
+        if self._direct:
+            # start black like a new image instead of with the console
+            buffer = self._fb.buffer()
+            buffer[:] = '\0' * len(buffer)
+            self.image = self._direct
+        else:
+            import kaa.imlib2
+            self.image = kaa.imlib2.new(self.size())
+
+
+    def _map_image(self):
+        """
+        Return an imlib2 image using the framebuffer memory, or None.
+        """
+        buffer = self._fb.buffer()
+        if buffer is None:
+            return None
         import kaa.imlib2
-        self.image = kaa.imlib2.new(fb.size())
+        return kaa.imlib2.new(self.size(), buffer, 'BGRA', copy=False)
 
 
-    def set_image(self, image):
+    def buffer(self):
         """
-        Set an imlib2 image to the frambuffer. The size of the image must match
-        the current framebuffer resolution.
+        Return the framebuffer memory drawn into as a writable buffer, or None
+        if it can't be drawn into directly.  See the class documentation.
+        The buffer raises an error once the framebuffer is closed, and its
+        writes are not shown while another console is.
+        """
+        return self._fb.buffer()
+
+
+    def set_image(self, image, pos=(0, 0)):
+        """
+        Set an imlib2 image to the frambuffer.  The image may have any size; it
+        is placed at pos on the screen and clipped to the framebuffer.  Parts
+        of the screen not covered by the image are left untouched.  Instead
+        of an imlib2 image a PixelBuffer can be set; its memory is read on
+        every update() without copying it first.
         """
-        if (image.width, image.height) != fb.size():
-            raise AttributeError('Invalid image size')
         self.image = image
+        self.pos = tuple(pos)
+        self._dirty = None
+
+
+    def invalidate(self, pos=None, size=None):
+        """
+        Mark an area as changed so it is copied on the next update().  Without
+        arguments the whole framebuffer is marked.
+        """
+        if pos is None or size is None:
+            self._dirty = None
+        elif self._dirty is not None:
+            self._dirty.append((tuple(pos), tuple(size)))
 
 
     def blend(self, src, src_pos = (0, 0), dst_pos = (0, 0)):
         """
-        Blend an imlib2 image to the framebuffer.
+        Blend an imlib2 image to the framebuffer.  This needs the image set
+        with set_image() to be an imlib2 image, not a PixelBuffer.
         """
+        if isinstance(self.image, PixelBuffer):
+            raise TypeError('blend() needs an imlib2 image, not a PixelBuffer')
         self.image.blend(src, src_pos=src_pos, dst_pos=dst_pos)
+        if self._dirty is not None:
+            self._dirty.append((tuple(dst_pos), (src.width - src_pos[0], src.height - src_pos[1])))
+
+
+    def set_scaling(self, filter='bilinear', overscan=(0, 0, 0, 0), keep_aspect=True):
+        """
+        Scale images set with set_image() to the screen, see
+        _Framebuffer.set_scaling.  The position given to set_image() is
+        ignored then.  Drawing into the framebuffer memory directly is never
+        scaled.
+        """
+        _Framebuffer.set_scaling(self, filter, overscan, keep_aspect)
+        self._dirty = None
 
 
-    def update(self):
+    def set_color_lut(self, lut):
         """
-        Update the framebuffer.
+        See _Framebuffer.set_color_lut.  The framebuffer memory can't be
+        drawn into directly with a colour table, so a direct self.image is
+        replaced by a copy.
         """
-        fb.update(self.image._image)
+        if self._direct and self.image is self._direct:
+            self.image = self._direct.copy()
+        self._direct = None
+        _Framebuffer.set_color_lut(self, lut)
+        self._dirty = None
+
+
+    def _vt_switch(self, acquire):
+        """
+        The framebuffer memory belongs to the other console while it is
+        shown and is replaced by memory nobody sees, so a direct self.image
+        is swapped for a copy meanwhile to keep its contents.
+        """
+        direct = getattr(self, '_direct', None)
+        if not acquire and direct and self.image is direct:
+            self.image = direct.copy()
+            self._vt_copy = self.image
+        _Framebuffer._vt_switch(self, acquire)
+        if acquire:
+            if getattr(self, '_vt_copy', None) is self.image:
+                self._direct = self._map_image()
+                self._fb.buffer()[:] = self.image.get_raw_data('BGRA')
+                self.image = self._direct
+            self._vt_copy = None
+            self._dirty = None
+
+
+    def capture(self, full=False):
+        """
+        Like _Framebuffer.capture, but self.image is captured as 32 bit
+        ARGB if it is not the framebuffer memory.  Nothing has to be read
+        from the framebuffer then, and the image has no colour table,
+        scaling or rotation applied.
+        """
+        if self._direct and self.image is self._direct:
+            return self._fb.capture(None, full)
+        return self._fb.capture(getattr(self.image, '_image', self.image), full)
+
+
+    def update(self, rects=None):
+        """
+        Update the framebuffer.  If rects, a list of ((x, y), (w, h)) areas,
+        is given, those are copied in addition to the areas changed by
+        blend() and invalidate().  If no area is known to have changed, the
+        whole image is copied.
+
+        When double buffered and waiting for vsync, returns True if the new
+        frame was shown on the first vblank after the request and False if
+        it was late.  Otherwise returns None.
+        """
+        dirty = None
+        if self._dirty is not None:
+            dirty = self._dirty + list(rects or [])
+        if self._direct and self.image is self._direct:
+            result = self._fb.update(None, dirty or None)
+            if self.double_buffered():
+                self.image = self._direct = self._map_image()
+        else:
+            image = getattr(self.image, '_image', self.image)
+            result = self._fb.update(image, dirty or None, self.pos)
+        self._dirty = []
+        return result
+
+
+    def __del__(self):
+        # Images may use the framebuffer memory.
+        self.image = self._direct = None
+        _Framebuffer.__del__(self)
@@ -0,0 +1,954 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbblit.c - Framebuffer blitting
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FBBLIT_X86
+#include <immintrin.h>
+#endif
+
+#include "fbblit.h"
+#include "colorlut.h"
+
+/* Framebuffer memory is often write-combined or uncached, and memcpy() is
+ * slow to fill it because it reads every destination line into the cache
+ * first.  Non-temporal stores write around the cache.  The copy used for
+ * rows that need no conversion is chosen at runtime from the CPU features.
+ */
+typedef void (*FBCopyFunc)(void *dst, const void *src, size_t n);
+
+// Rows shorter than this are copied with memcpy()
+#define STREAM_MIN 256
+
+// Pixels looked up in the colour table at a time
+#define LUT_CHUNK 512
+
+static void copy_memcpy(void *dst, const void *src, size_t n)
+{
+    memcpy(dst, src, n);
+}
+
+#ifdef FBBLIT_X86
+__attribute__((target("sse2")))
+static void copy_sse2(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+    size_t head;
+
+    if (n < STREAM_MIN) {
+        memcpy(d, s, n);
+        return;
+    }
+    // Streaming stores need an aligned destination.
+    head = -(uintptr_t)d & 15;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i *)s);
+        __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+        _mm_stream_si128((__m128i *)d, a);
+        _mm_stream_si128((__m128i *)(d + 16), b);
+        _mm_stream_si128((__m128i *)(d + 32), c);
+        _mm_stream_si128((__m128i *)(d + 48), e);
+    }
+    for (; n >= 16; n -= 16, d += 16, s += 16)
+        _mm_stream_si128((__m128i *)d, _mm_loadu_si128((const __m128i *)s));
+    // Streaming stores are weakly ordered; make them visible before
+    // anything that follows.
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+
+__attribute__((target("avx")))
+static void copy_avx(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+    size_t head;
+
+    if (n < STREAM_MIN) {
+        memcpy(d, s, n);
+        return;
+    }
+    head = -(uintptr_t)d & 31;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for (; n >= 128; n -= 128, d += 128, s += 128) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+        _mm256_stream_si256((__m256i *)d, a);
+        _mm256_stream_si256((__m256i *)(d + 32), b);
+        _mm256_stream_si256((__m256i *)(d + 64), c);
+        _mm256_stream_si256((__m256i *)(d + 96), e);
+    }
+    for (; n >= 32; n -= 32, d += 32, s += 32)
+        _mm256_stream_si256((__m256i *)d, _mm256_loadu_si256((const __m256i *)s));
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+#endif
+
+#ifdef __aarch64__
+static void copy_neon(void *dst, const void *src, size_t n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+    size_t head;
+
+    if (n < STREAM_MIN) {
+        memcpy(d, s, n);
+        return;
+    }
+    head = -(uintptr_t)d & 15;
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64)
+        __asm__ volatile("ldp q0, q1, [%1]\n\t"
+                         "ldp q2, q3, [%1, #32]\n\t"
+                         "stnp q0, q1, [%0]\n\t"
+                         "stnp q2, q3, [%0, #32]"
+                         : : "r" (d), "r" (s) : "v0", "v1", "v2", "v3", "memory");
+    __asm__ volatile("dmb ishst" : : : "memory");
+    memcpy(d, s, n);
+}
+#endif
+
+static int cpu_supports(const char *feature)
+{
+#ifdef FBBLIT_X86
+    if (!strcmp(feature, "avx"))
+        return __builtin_cpu_supports("avx");
+    if (!strcmp(feature, "sse2"))
+        return __builtin_cpu_supports("sse2");
+#endif
+    return 1;
+}
+
+// Best first
+static const struct {
+    const char *name;
+    FBCopyFunc func;
+} copy_engines[] = {
+#ifdef __aarch64__
+    { "neon", copy_neon },
+#endif
+#ifdef FBBLIT_X86
+    { "avx", copy_avx },
+    { "sse2", copy_sse2 },
+#endif
+    { "memcpy", copy_memcpy },
+    { NULL, NULL }
+};
+
+// NULL picks one per surface
+static FBCopyFunc copy_func = NULL;
+static const char *copy_name = NULL;
+static FBCopyFunc best_copy_func = NULL;
+
+/* Name of the i-th copy engine this CPU supports, best first, or NULL */
+const char *fbblit_get_copy_engine(int i)
+{
+    int j;
+
+    for (j = 0; copy_engines[j].name; j++)
+        if (cpu_supports(copy_engines[j].name) && i-- == 0)
+            return copy_engines[j].name;
+    return NULL;
+}
+
+/* Use the named copy engine for all surfaces.  If name is NULL, uncached
+ * (device) surfaces use the best engine and all others memcpy, which is
+ * faster in cacheable memory.  Returns 0 if the engine isn't supported.
+ */
+int fbblit_set_copy_engine(const char *name)
+{
+    int j;
+
+    if (!name) {
+        copy_func = NULL;
+        copy_name = NULL;
+        return 1;
+    }
+    for (j = 0; copy_engines[j].name; j++) {
+        if (strcmp(name, copy_engines[j].name) || !cpu_supports(copy_engines[j].name))
+            continue;
+        copy_func = copy_engines[j].func;
+        copy_name = copy_engines[j].name;
+        return 1;
+    }
+    return 0;
+}
+
+/* The engine set with fbblit_set_copy_engine(), or NULL if chosen per surface */
+const char *fbblit_copy_engine(void)
+{
+    return copy_name;
+}
+
+static FBCopyFunc surface_copy_func(FBSurface *surface)
+{
+    int j;
+
+    if (copy_func)
+        return copy_func;
+    if (!surface->uncached)
+        return copy_memcpy;
+    if (!best_copy_func) {
+        for (j = 0; !cpu_supports(copy_engines[j].name); j++)
+            ;
+        best_copy_func = copy_engines[j].func;
+    }
+    return best_copy_func;
+}
+
+/* 4x4 ordered dither matrix, values 0..15 */
+static const unsigned char bayer4[4][4] = {
+    {  0,  8,  2, 10 },
+    { 12,  4, 14,  6 },
+    {  3, 11,  1,  9 },
+    { 15,  7, 13,  5 }
+};
+
+/* Convert one ARGB32 pixel using the shifts from fbblit_setup() */
+static inline uint32_t convert_pixel(FBSurface *surface, uint32_t p)
+{
+    uint32_t v = 0;
+    int i;
+
+    for (i = 0; i < surface->n_shifts; i++)
+        v |= ((p >> surface->shifts[i].right) & surface->shifts[i].mask) <<
+             surface->shifts[i].left;
+    return v;
+}
+
+static void convert_row_copy(unsigned char *dst, const uint32_t *src, int n,
+                             FBSurface *surface, int x, int y)
+{
+    surface_copy_func(surface)(dst, src, n * 4);
+}
+
+static void convert_row_32(unsigned char *dst, const uint32_t *src, int n,
+                           FBSurface *surface, int x, int y)
+{
+    uint32_t *d = (uint32_t *)dst;
+    int i = 0, c;
+
+#ifdef __SSE2__
+    __m128i right[4], left[4], mask[4];
+
+    for (c = 0; c < surface->n_shifts; c++) {
+        right[c] = _mm_cvtsi32_si128(surface->shifts[c].right);
+        left[c] = _mm_cvtsi32_si128(surface->shifts[c].left);
+        mask[c] = _mm_set1_epi32(surface->shifts[c].mask);
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i v = _mm_setzero_si128();
+        for (c = 0; c < surface->n_shifts; c++)
+            v = _mm_or_si128(v, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(p, right[c]),
+                                                            mask[c]), left[c]));
+        _mm_storeu_si128((__m128i *)(d + i), v);
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = convert_pixel(surface, src[i]);
+}
+
+#ifdef __SSE2__
+/* Narrow two vectors of 32-bit values below 0x10000 to one of 16-bit values.
+ * _mm_packs_epi32() saturates signed, so sign extend the low halves first. */
+static inline __m128i pack_16(__m128i a, __m128i b)
+{
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+#endif
+
+static void convert_row_16(unsigned char *dst, const uint32_t *src, int n,
+                           FBSurface *surface, int x, int y)
+{
+    uint16_t *d = (uint16_t *)dst;
+    int i = 0, c;
+
+#ifdef __SSE2__
+    __m128i right[4], left[4], mask[4];
+
+    for (c = 0; c < surface->n_shifts; c++) {
+        right[c] = _mm_cvtsi32_si128(surface->shifts[c].right);
+        left[c] = _mm_cvtsi32_si128(surface->shifts[c].left);
+        mask[c] = _mm_set1_epi32(surface->shifts[c].mask);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        __m128i v0 = _mm_setzero_si128(), v1 = _mm_setzero_si128();
+        for (c = 0; c < surface->n_shifts; c++) {
+            v0 = _mm_or_si128(v0, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(p0, right[c]),
+                                                              mask[c]), left[c]));
+            v1 = _mm_or_si128(v1, _mm_sll_epi32(_mm_and_si128(_mm_srl_epi32(p1, right[c]),
+                                                              mask[c]), left[c]));
+        }
+        _mm_storeu_si128((__m128i *)(d + i), pack_16(v0, v1));
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = convert_pixel(surface, src[i]);
+}
+
+static inline uint16_t rgb565(uint32_t p)
+{
+    return ((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f);
+}
+
+static void convert_row_565(unsigned char *dst, const uint32_t *src, int n,
+                            FBSurface *surface, int x, int y)
+{
+    uint16_t *d = (uint16_t *)dst;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i rmask = _mm_set1_epi32(0xf800);
+    const __m128i gmask = _mm_set1_epi32(0x07e0);
+    const __m128i bmask = _mm_set1_epi32(0x001f);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        p0 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 8), rmask),
+                                       _mm_and_si128(_mm_srli_epi32(p0, 5), gmask)),
+                          _mm_and_si128(_mm_srli_epi32(p0, 3), bmask));
+        p1 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 8), rmask),
+                                       _mm_and_si128(_mm_srli_epi32(p1, 5), gmask)),
+                          _mm_and_si128(_mm_srli_epi32(p1, 3), bmask));
+        _mm_storeu_si128((__m128i *)(d + i), pack_16(p0, p1));
+    }
+#endif
+    for (; i < n; i++)
+        d[i] = rgb565(src[i]);
+}
+
+/* Add the dither offset for the pixel at (x, y) to each channel, saturating.
+ * Red and blue lose 3 bits and green 2, so the offsets are 0..7 and 0..3. */
+static inline uint32_t dither_offset(int x, int y)
+{
+    int t = bayer4[y & 3][x & 3];
+    return (t >> 1) | ((t >> 2) << 8) | ((t >> 1) << 16);
+}
+
+static void convert_row_565_dither(unsigned char *dst, const uint32_t *src, int n,
+                                   FBSurface *surface, int x, int y)
+{
+    uint16_t *d = (uint16_t *)dst;
+    uint32_t p, o;
+    int i = 0, r, g, b;
+
+#ifdef __SSE2__
+    const __m128i rmask = _mm_set1_epi32(0xf800);
+    const __m128i gmask = _mm_set1_epi32(0x07e0);
+    const __m128i bmask = _mm_set1_epi32(0x001f);
+    // The pattern repeats every 4 pixels, so it is the same for every vector.
+    const __m128i pattern = _mm_setr_epi32(dither_offset(x, y), dither_offset(x + 1, y),
+                                           dither_offset(x + 2, y), dither_offset(x + 3, y));
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        p0 = _mm_adds_epu8(p0, pattern);
+        p1 = _mm_adds_epu8(p1, pattern);
+        p0 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p0, 8), rmask),
+                                       _mm_and_si128(_mm_srli_epi32(p0, 5), gmask)),
+                          _mm_and_si128(_mm_srli_epi32(p0, 3), bmask));
+        p1 = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p1, 8), rmask),
+                                       _mm_and_si128(_mm_srli_epi32(p1, 5), gmask)),
+                          _mm_and_si128(_mm_srli_epi32(p1, 3), bmask));
+        _mm_storeu_si128((__m128i *)(d + i), pack_16(p0, p1));
+    }
+#endif
+    for (; i < n; i++) {
+        p = src[i];
+        o = dither_offset(x + i, y);
+        r = ((p >> 16) & 0xff) + (o >> 16);
+        g = ((p >> 8) & 0xff) + ((o >> 8) & 0xff);
+        b = (p & 0xff) + (o & 0xff);
+        d[i] = rgb565(((r > 255 ? 255 : r) << 16) | ((g > 255 ? 255 : g) << 8) |
+                      (b > 255 ? 255 : b));
+    }
+}
+
+/* 24 bits with the channels in the same place as ARGB32, i.e. B, G, R bytes */
+static void convert_row_24_bgr(unsigned char *dst, const uint32_t *src, int n,
+                               FBSurface *surface, int x, int y)
+{
+    int i = 0;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Four pixels go into three words.
+    uint32_t w[3];
+    for (; i + 4 <= n; i += 4, dst += 12) {
+        w[0] = (src[i] & 0xffffff) | (src[i + 1] << 24);
+        w[1] = ((src[i + 1] >> 8) & 0xffff) | (src[i + 2] << 16);
+        w[2] = ((src[i + 2] >> 16) & 0xff) | (src[i + 3] << 8);
+        memcpy(dst, w, 12);
+    }
+#endif
+    for (; i < n; i++, dst += 3) {
+        dst[0] = src[i];
+        dst[1] = src[i] >> 8;
+        dst[2] = src[i] >> 16;
+    }
+}
+
+static void convert_row_24(unsigned char *dst, const uint32_t *src, int n,
+                           FBSurface *surface, int x, int y)
+{
+    uint32_t v;
+    int i;
+
+    for (i = 0; i < n; i++, dst += 3) {
+        v = convert_pixel(surface, src[i]);
+        dst[0] = v;
+        dst[1] = v >> 8;
+        dst[2] = v >> 16;
+    }
+}
+
+static int is_channel(FBChannel *c, int offset, int length)
+{
+    return c->offset == offset && c->length == length;
+}
+
+/* Choose the conversion from ARGB32 into the pixel format described by
+ * bytes_per_pixel and the channels of the surface.  Returns 0 if the format
+ * is not supported.
+ */
+int fbblit_setup(FBSurface *surface)
+{
+    FBChannel *channels[4] = { &surface->blue, &surface->green, &surface->red,
+                               &surface->transp };
+    int i, bpp = surface->bytes_per_pixel;
+
+    // Shifts to get each channel from its place in ARGB32 to the framebuffer.
+    surface->n_shifts = 0;
+    for (i = 0; i < 4; i++) {
+        FBChannel *c = channels[i];
+        int n = surface->n_shifts;
+
+        if (c->length <= 0)
+            continue;
+        if (c->offset + c->length > bpp * 8)
+            return 0;
+        if (c->length <= 8) {
+            surface->shifts[n].right = i * 8 + 8 - c->length;
+            surface->shifts[n].left = c->offset;
+            surface->shifts[n].mask = (1 << c->length) - 1;
+        } else {
+            surface->shifts[n].right = i * 8;
+            surface->shifts[n].left = c->offset + c->length - 8;
+            surface->shifts[n].mask = 0xff;
+        }
+        surface->n_shifts++;
+    }
+
+    surface->native = 0;
+    switch (bpp) {
+    case 4:
+        if (is_channel(&surface->red, 16, 8) && is_channel(&surface->green, 8, 8) &&
+            is_channel(&surface->blue, 0, 8) &&
+            (surface->transp.length == 0 || is_channel(&surface->transp, 24, 8))) {
+            surface->convert_pixels = convert_row_copy;
+            surface->native = 1;
+        } else
+            surface->convert_pixels = convert_row_32;
+        break;
+    case 3:
+        if (is_channel(&surface->red, 16, 8) && is_channel(&surface->green, 8, 8) &&
+            is_channel(&surface->blue, 0, 8))
+            surface->convert_pixels = convert_row_24_bgr;
+        else
+            surface->convert_pixels = convert_row_24;
+        break;
+    case 2:
+        if (is_channel(&surface->red, 11, 5) && is_channel(&surface->green, 5, 6) &&
+            is_channel(&surface->blue, 0, 5))
+            surface->convert_pixels = surface->dither ? convert_row_565_dither :
+                                                        convert_row_565;
+        else
+            surface->convert_pixels = convert_row_16;
+        break;
+    default:
+        return 0;
+    }
+    fbblit_set_lut(surface, surface->lut);
+    return 1;
+}
+
+/* Apply the colour table in pieces that stay in the cache, then convert */
+static void convert_row_lut(unsigned char *dst, const uint32_t *src, int n,
+                            FBSurface *surface, int x, int y)
+{
+    uint32_t buf[LUT_CHUNK];
+    int i, len;
+
+    for (i = 0; i < n; i += len) {
+        len = n - i < LUT_CHUNK ? n - i : LUT_CHUNK;
+        colorlut_apply(surface->lut, buf, src + i, len);
+        surface->convert_pixels(dst + i * surface->bytes_per_pixel, buf, len, surface,
+                                x + i, y);
+    }
+}
+
+/* Look up every pixel in lut before converting it, or stop if it is NULL.
+ * The table must stay around while it is in use.
+ */
+void fbblit_set_lut(FBSurface *surface, const ColorLUT *lut)
+{
+    surface->lut = lut;
+    surface->convert_row = lut ? convert_row_lut : surface->convert_pixels;
+}
+
+
+#ifdef __SSE2__
+/* Transpose the 4x4 block of pixels in r0 to r3 */
+#define TRANSPOSE4(r0, r1, r2, r3) do {                                 \
+        __m128i t0 = _mm_unpacklo_epi32(r0, r1);                        \
+        __m128i t1 = _mm_unpacklo_epi32(r2, r3);                        \
+        __m128i t2 = _mm_unpackhi_epi32(r0, r1);                        \
+        __m128i t3 = _mm_unpackhi_epi32(r2, r3);                        \
+        r0 = _mm_unpacklo_epi64(t0, t1);                                \
+        r1 = _mm_unpackhi_epi64(t0, t1);                                \
+        r2 = _mm_unpacklo_epi64(t2, t3);                                \
+        r3 = _mm_unpackhi_epi64(t2, t3);                                \
+    } while (0)
+#endif
+
+/* Fill the w x h tile with tile[j * FBBLIT_TILE + i] = p[i * di + j * dj],
+ * where (di, dj) is (-stride, 1) for 90, (-1, -stride) for 180 and
+ * (stride, -1) for 270 degrees.  Whole 4x4 blocks are transposed or
+ * reversed in registers.
+ */
+static void fill_tile(uint32_t *tile, const uint32_t *p, int stride, int rotation,
+                      int w, int h)
+{
+    int di, dj, i, j, i4 = 0, j4 = 0;
+
+    switch (rotation) {
+    case FBBLIT_ROTATE_90:
+        di = -stride;
+        dj = 1;
+        break;
+    case FBBLIT_ROTATE_180:
+        di = -1;
+        dj = -stride;
+        break;
+    default:
+        di = stride;
+        dj = -1;
+        break;
+    }
+
+#ifdef __SSE2__
+    i4 = w & ~3;
+    j4 = h & ~3;
+    for (j = 0; j < j4; j += 4) {
+        for (i = 0; i < i4; i += 4) {
+            uint32_t *t = tile + j * FBBLIT_TILE + i;
+            const uint32_t *s = p + i * di + j * dj;
+            __m128i r0, r1, r2, r3;
+            int k;
+
+            if (rotation == FBBLIT_ROTATE_180) {
+                // rows of the block are source rows read backwards
+                for (k = 0; k < 4; k++, t += FBBLIT_TILE, s += dj) {
+                    r0 = _mm_loadu_si128((const __m128i *)(s - 3));
+                    _mm_storeu_si128((__m128i *)t, _mm_shuffle_epi32(r0, 0x1b));
+                }
+                continue;
+            }
+            if (rotation == FBBLIT_ROTATE_90) {
+                // source rows become block columns
+                r0 = _mm_loadu_si128((const __m128i *)s);
+                r1 = _mm_loadu_si128((const __m128i *)(s + di));
+                r2 = _mm_loadu_si128((const __m128i *)(s + 2 * di));
+                r3 = _mm_loadu_si128((const __m128i *)(s + 3 * di));
+                TRANSPOSE4(r0, r1, r2, r3);
+            } else {
+                // the same, but the source columns run backwards
+                r3 = _mm_loadu_si128((const __m128i *)(s - 3));
+                r2 = _mm_loadu_si128((const __m128i *)(s + di - 3));
+                r1 = _mm_loadu_si128((const __m128i *)(s + 2 * di - 3));
+                r0 = _mm_loadu_si128((const __m128i *)(s + 3 * di - 3));
+                TRANSPOSE4(r3, r2, r1, r0);
+            }
+            _mm_storeu_si128((__m128i *)t, r0);
+            _mm_storeu_si128((__m128i *)(t + FBBLIT_TILE), r1);
+            _mm_storeu_si128((__m128i *)(t + 2 * FBBLIT_TILE), r2);
+            _mm_storeu_si128((__m128i *)(t + 3 * FBBLIT_TILE), r3);
+        }
+    }
+#endif
+
+    // whatever is left of the right and bottom edge
+    for (j = 0; j < h; j++)
+        for (i = j < j4 ? i4 : 0; i < w; i++)
+            tile[j * FBBLIT_TILE + i] = p[i * di + j * dj];
+}
+
+/* Draw the w x h pixels starting at s to the logical position (x, y) of a
+ * rotated surface.  The destination is filled in tiles small enough to stay
+ * in the cache, so both the source and the destination are mostly read and
+ * written in whole lines.
+ */
+static void blit_rotated(FBSurface *dst, const uint32_t *s, int stride, int x, int y,
+                         int w, int h)
+{
+    uint32_t tile[FBBLIT_TILE * FBBLIT_TILE];
+    const uint32_t *p;
+    int px, py, pw, ph, tx, ty, tw, th, j;
+
+    // the rect on the screen
+    switch (dst->rotation) {
+    case FBBLIT_ROTATE_90:
+        px = dst->width - y - h;
+        py = x;
+        pw = h;
+        ph = w;
+        break;
+    case FBBLIT_ROTATE_180:
+        px = dst->width - x - w;
+        py = dst->height - y - h;
+        pw = w;
+        ph = h;
+        break;
+    default:
+        px = y;
+        py = dst->height - x - w;
+        pw = h;
+        ph = w;
+        break;
+    }
+
+    for (ty = py; ty < py + ph; ty += FBBLIT_TILE) {
+        th = py + ph - ty < FBBLIT_TILE ? py + ph - ty : FBBLIT_TILE;
+        for (tx = px; tx < px + pw; tx += FBBLIT_TILE) {
+            tw = px + pw - tx < FBBLIT_TILE ? px + pw - tx : FBBLIT_TILE;
+            // source pixel for the top left corner of the tile
+            switch (dst->rotation) {
+            case FBBLIT_ROTATE_90:
+                p = s + (dst->width - 1 - y - tx) * stride + (ty - x);
+                break;
+            case FBBLIT_ROTATE_180:
+                p = s + (dst->height - 1 - y - ty) * stride + (dst->width - 1 - x - tx);
+                break;
+            default:
+                p = s + (tx - y) * stride + (dst->height - 1 - x - ty);
+                break;
+            }
+            fill_tile(tile, p, stride, dst->rotation, tw, th);
+            for (j = 0; j < th; j++)
+                dst->convert_row(dst->mem + (ty + j) * dst->line_length +
+                                 tx * dst->bytes_per_pixel,
+                                 tile + j * FBBLIT_TILE, tw, dst, tx, ty + j);
+        }
+    }
+}
+
+/* Copy the rectangle (x, y, w, h) of the source to (dst_x + x, dst_y + y) of
+ * the destination, i.e. the source image is placed at (dst_x, dst_y).  The
+ * rectangle is clipped to the source and the destination.  Pixels are
+ * converted to the framebuffer format on the way.  Coordinates are logical
+ * ones if the destination is rotated.
+ */
+void fbblit_rect(FBSurface *dst, FBSource *src, int x, int y, int w, int h,
+                 int dst_x, int dst_y)
+{
+    const uint32_t *s;
+    unsigned char *d;
+    int row, dst_w = FBSURFACE_WIDTH(dst), dst_h = FBSURFACE_HEIGHT(dst);
+
+    // Clip to the source image.
+    if (x < 0) { w += x; x = 0; }
+    if (y < 0) { h += y; y = 0; }
+    if (x + w > src->width) w = src->width - x;
+    if (y + h > src->height) h = src->height - y;
+
+    // Clip to the destination.
+    if (dst_x + x < 0) { w += dst_x + x; x = -dst_x; }
+    if (dst_y + y < 0) { h += dst_y + y; y = -dst_y; }
+    if (dst_x + x + w > dst_w) w = dst_w - dst_x - x;
+    if (dst_y + y + h > dst_h) h = dst_h - dst_y - y;
+
+    if (w <= 0 || h <= 0)
+        return;
+
+    s = src->pixels + y * src->stride + x;
+    if (dst->rotation != FBBLIT_ROTATE_0) {
+        blit_rotated(dst, s, src->stride, dst_x + x, dst_y + y, w, h);
+        return;
+    }
+    d = dst->mem + (dst_y + y) * dst->line_length + (dst_x + x) * dst->bytes_per_pixel;
+    for (row = 0; row < h; row++) {
+        dst->convert_row(d, s, w, dst, dst_x + x, dst_y + y + row);
+        s += src->stride;
+        d += dst->line_length;
+    }
+}
+
+
+/* Worker pool for large updates.  A job is run once per thread including
+ * the calling one, each time with another band number.  Blits cut the
+ * updated lines into horizontal bands, so the threads never write to the
+ * same lines.
+ */
+typedef struct {
+    FBBlitPool *pool;
+    int band;
+    pthread_t thread;
+} FBBlitWorker;
+
+struct _FBBlitPool {
+    int n_workers;          // the calling thread does one more band
+    FBBlitWorker *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    unsigned int generation;
+    int pending, quit;
+
+    // the current job
+    FBBandFunc func;
+    void *data;
+};
+
+static void *worker_main(void *arg)
+{
+    FBBlitWorker *worker = arg;
+    FBBlitPool *pool = worker->pool;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->generation == generation && !pool->quit)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->quit)
+            break;
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->func(pool->data, worker->band, pool->n_workers + 1);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Create a pool using n_threads threads in total, i.e. n_threads - 1
+ * workers besides the calling thread.  Returns NULL if n_threads < 2 or the
+ * threads can't be started.
+ */
+FBBlitPool *fbblit_pool_new(int n_threads)
+{
+    FBBlitPool *pool;
+    int i;
+
+    if (n_threads < 2)
+        return NULL;
+    pool = calloc(1, sizeof(FBBlitPool));
+    if (!pool)
+        return NULL;
+    pool->workers = calloc(n_threads - 1, sizeof(FBBlitWorker));
+    if (!pool->workers) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 0; i < n_threads - 1; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].band = i + 1;
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]))
+            break;
+        pool->n_workers++;
+    }
+    if (!pool->n_workers) {
+        fbblit_pool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void fbblit_pool_free(FBBlitPool *pool)
+{
+    int i;
+
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 0; i < pool->n_workers; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+/* Number of pixels in the given rects, counting overlaps twice */
+int fbblit_rects_area(const int *rects, int n_rects)
+{
+    int i, area = 0;
+
+    for (i = 0; i < n_rects; i++)
+        if (rects[i * 4 + 2] > 0 && rects[i * 4 + 3] > 0)
+            area += rects[i * 4 + 2] * rects[i * 4 + 3];
+    return area;
+}
+
+int fbblit_pool_size(FBBlitPool *pool)
+{
+    return pool ? pool->n_workers + 1 : 1;
+}
+
+/* Run func(data, band, n_bands) for every band, in parallel if there is a
+ * pool.  Returns when all bands are done.
+ */
+void fbblit_pool_run(FBBlitPool *pool, FBBandFunc func, void *data)
+{
+    if (!pool) {
+        func(data, 0, 1);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->func = func;
+    pool->data = data;
+    pool->pending = pool->n_workers;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    func(data, 0, pool->n_workers + 1);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+typedef struct {
+    FBSurface *dst;
+    FBSource *src;
+    const int *rects;
+    int n_rects, dst_x, dst_y;
+    int y0, y1;             // lines covered by the rects
+} FBBlitJob;
+
+/* Bands are cut from the lines covered by all rects rather than from every
+ * rect on its own, so overlapping rects can't be written by two threads.
+ */
+static void blit_band(void *data, int band, int n_bands)
+{
+    FBBlitJob *job = data;
+    const int *r;
+    int i, y0, y1, top, bottom;
+
+    top = job->y0 + (job->y1 - job->y0) * band / n_bands;
+    bottom = job->y0 + (job->y1 - job->y0) * (band + 1) / n_bands;
+    for (i = 0; i < job->n_rects; i++) {
+        r = job->rects + i * 4;
+        y0 = r[1] > top ? r[1] : top;
+        y1 = r[1] + r[3] < bottom ? r[1] + r[3] : bottom;
+        if (y1 > y0)
+            fbblit_rect(job->dst, job->src, r[0], y0, r[2], y1 - y0, job->dst_x, job->dst_y);
+    }
+}
+
+/* Copy the given rects (x, y, w, h) of the source with fbblit_rect, or the
+ * whole source if n_rects is -1.  Updates of at least FBBLIT_THREAD_MIN
+ * pixels are shared with the pool, if there is one.
+ */
+void fbblit_rects(FBSurface *dst, FBSource *src, const int *rects, int n_rects,
+                  int dst_x, int dst_y, FBBlitPool *pool)
+{
+    int full[4] = { 0, 0, src->width, src->height };
+    FBBlitJob job;
+    int i;
+
+    if (n_rects < 0) {
+        rects = full;
+        n_rects = 1;
+    }
+    job.dst = dst;
+    job.src = src;
+    job.rects = rects;
+    job.n_rects = n_rects;
+    job.dst_x = dst_x;
+    job.dst_y = dst_y;
+    job.y0 = INT_MAX;
+    job.y1 = INT_MIN;
+    for (i = 0; i < n_rects; i++) {
+        if (rects[i * 4 + 1] < job.y0)
+            job.y0 = rects[i * 4 + 1];
+        if (rects[i * 4 + 1] + rects[i * 4 + 3] > job.y1)
+            job.y1 = rects[i * 4 + 1] + rects[i * 4 + 3];
+    }
+    if (job.y1 <= job.y0)
+        return;
+    if (fbblit_rects_area(rects, n_rects) < FBBLIT_THREAD_MIN)
+        pool = NULL;
+    fbblit_pool_run(pool, blit_band, &job);
+}
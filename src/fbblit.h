@@ -0,0 +1,121 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbblit.h - Framebuffer blitting
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FBBLIT_H_
+#define _FBBLIT_H_
+
+#include <stdint.h>
+
+struct _FBSurface;
+struct _ColorLUT;
+
+// Converts n source pixels into the destination format.  x and y are the
+// destination coordinates of the first pixel.
+typedef void (*FBConvertRow)(unsigned char *dst, const uint32_t *src, int n,
+                             struct _FBSurface *surface, int x, int y);
+
+// Position and size in bits of a colour channel within a pixel
+typedef struct {
+    int offset, length;
+} FBChannel;
+
+// A block of (framebuffer) memory to blit into.
+typedef struct _FBSurface {
+    unsigned char *mem;     // first visible pixel
+    int line_length;        // bytes from one line to the next
+    int width, height;      // visible size in pixels
+    int bytes_per_pixel;
+    FBChannel red, green, blue, transp;
+    int dither;             // ordered dithering for RGB565
+    int rotation;           // FBBLIT_ROTATE_*, how the picture is turned
+    int uncached;           // device memory, see fbblit_set_copy_engine()
+    const struct _ColorLUT *lut;    // see fbblit_set_lut()
+
+    // Filled in by fbblit_setup()
+    FBConvertRow convert_row;
+    FBConvertRow convert_pixels;    // convert_row without the colour table
+    int native;             // ARGB32, i.e. no conversion needed
+    int n_shifts;
+    struct {
+        int right, left;
+        uint32_t mask;
+    } shifts[4];
+} FBSurface;
+
+// Clockwise rotation of what is blitted, for panels mounted sideways or
+// upside down.  Blits use the rotated ("logical") coordinates.
+enum {
+    FBBLIT_ROTATE_0,
+    FBBLIT_ROTATE_90,
+    FBBLIT_ROTATE_180,
+    FBBLIT_ROTATE_270
+};
+
+#define FBSURFACE_WIDTH(s) ((s)->rotation & 1 ? (s)->height : (s)->width)
+#define FBSURFACE_HEIGHT(s) ((s)->rotation & 1 ? (s)->width : (s)->height)
+
+// Rotated blits go through a cache sized tile of this many pixels squared.
+#define FBBLIT_TILE 64
+
+// 32-bit ARGB pixels to blit from.
+typedef struct {
+    const uint32_t *pixels;
+    int width, height;
+    int stride;             // pixels from one line to the next
+} FBSource;
+
+const char *fbblit_get_copy_engine(int i);
+int fbblit_set_copy_engine(const char *name);
+const char *fbblit_copy_engine(void);
+
+// Smaller updates are not worth waking up the worker threads for.
+#define FBBLIT_THREAD_MIN (256 * 256)
+
+typedef struct _FBBlitPool FBBlitPool;
+
+// Does its part of a job split into n_bands bands.
+typedef void (*FBBandFunc)(void *data, int band, int n_bands);
+
+int fbblit_setup(FBSurface *dst);
+void fbblit_set_lut(FBSurface *surface, const struct _ColorLUT *lut);
+void fbblit_rect(FBSurface *dst, FBSource *src, int x, int y, int w, int h,
+                 int dst_x, int dst_y);
+void fbblit_rects(FBSurface *dst, FBSource *src, const int *rects, int n_rects,
+                  int dst_x, int dst_y, FBBlitPool *pool);
+
+FBBlitPool *fbblit_pool_new(int n_threads);
+void fbblit_pool_free(FBBlitPool *pool);
+int fbblit_pool_size(FBBlitPool *pool);
+void fbblit_pool_run(FBBlitPool *pool, FBBandFunc func, void *data);
+int fbblit_rects_area(const int *rects, int n_rects);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbcapture.c - Framebuffer capture
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FBCAPTURE_X86
+#include <smmintrin.h>
+#endif
+
+#include "fbcapture.h"
+
+/* A capture is encoded as a header followed by the tiles that changed,
+ * all numbers 16 bit little endian:
+ *
+ *   width, height, bytes per pixel, tile size, number of tiles
+ *   for each tile: x, y, width, height and its lines without padding
+ *
+ * Tiles are FBCAPTURE_TILE pixels square except at the right and bottom
+ * edges.  Each tile is copied to the output once and compared with the
+ * snapshot from there, so the source is read only once; this matters for
+ * framebuffer memory, which is slow to read.
+ */
+
+typedef void (*CopyFunc)(unsigned char *dst, const unsigned char *src, int len);
+
+static void copy_plain(unsigned char *dst, const unsigned char *src, int len)
+{
+    memcpy(dst, src, len);
+}
+
+#ifdef FBCAPTURE_X86
+/* Framebuffer memory is mapped write-combining, where normal loads go to
+ * the bus one at a time.  Streaming loads fetch whole lines at once.
+ */
+__attribute__((target("sse4.1")))
+static void copy_stream(unsigned char *dst, const unsigned char *src, int len)
+{
+    __m128i a, b, c, d;
+    int i = 0;
+
+    if (((uintptr_t)src & 15) == 0) {
+        for (; i + 64 <= len; i += 64) {
+            a = _mm_stream_load_si128((__m128i *)(src + i));
+            b = _mm_stream_load_si128((__m128i *)(src + i + 16));
+            c = _mm_stream_load_si128((__m128i *)(src + i + 32));
+            d = _mm_stream_load_si128((__m128i *)(src + i + 48));
+            _mm_storeu_si128((__m128i *)(dst + i), a);
+            _mm_storeu_si128((__m128i *)(dst + i + 16), b);
+            _mm_storeu_si128((__m128i *)(dst + i + 32), c);
+            _mm_storeu_si128((__m128i *)(dst + i + 48), d);
+        }
+    }
+    memcpy(dst + i, src + i, len - i);
+}
+#endif
+
+static unsigned char *put16(unsigned char *p, int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    return p + 2;
+}
+
+/* Forget the last capture, so the next one has all tiles. */
+void fbcapture_reset(FBCapture *capture)
+{
+    capture->valid = 0;
+}
+
+void fbcapture_free(FBCapture *capture)
+{
+    free(capture->snapshot);
+    free(capture->out);
+    memset(capture, 0, sizeof(*capture));
+}
+
+/* Encode the tiles of the image at mem that changed since the last capture
+ * into capture->out and return its length, or 0 if there is no memory.
+ * Set uncached for framebuffer memory.  The buffers are kept for the next
+ * capture of the same size.
+ */
+size_t fbcapture_tiles(FBCapture *capture, const unsigned char *mem, int stride,
+                       int width, int height, int bytes_per_pixel, int uncached)
+{
+    CopyFunc copy = copy_plain;
+    unsigned char *p, *tile, *snap;
+    int tx, ty, x, y, w, h, row, len, changed, n = 0;
+    size_t size;
+
+    if (width != capture->width || height != capture->height ||
+        bytes_per_pixel != capture->bytes_per_pixel) {
+        fbcapture_free(capture);
+        size = (size_t)width * height * bytes_per_pixel;
+        capture->out_size = 10 + size + 8 * (size_t)((width + FBCAPTURE_TILE - 1) / FBCAPTURE_TILE) *
+                            ((height + FBCAPTURE_TILE - 1) / FBCAPTURE_TILE);
+        capture->snapshot = malloc(size);
+        capture->out = malloc(capture->out_size);
+        if (!capture->snapshot || !capture->out) {
+            fbcapture_free(capture);
+            return 0;
+        }
+        capture->width = width;
+        capture->height = height;
+        capture->bytes_per_pixel = bytes_per_pixel;
+    }
+
+#ifdef FBCAPTURE_X86
+    if (uncached && __builtin_cpu_supports("sse4.1"))
+        copy = copy_stream;
+#endif
+
+    p = capture->out + 10;
+    for (ty = 0; ty * FBCAPTURE_TILE < height; ty++) {
+        y = ty * FBCAPTURE_TILE;
+        h = height - y < FBCAPTURE_TILE ? height - y : FBCAPTURE_TILE;
+        for (tx = 0; tx * FBCAPTURE_TILE < width; tx++) {
+            x = tx * FBCAPTURE_TILE;
+            w = width - x < FBCAPTURE_TILE ? width - x : FBCAPTURE_TILE;
+            len = w * bytes_per_pixel;
+
+            tile = put16(put16(put16(put16(p, x), y), w), h);
+            snap = capture->snapshot + ((size_t)y * width + x) * bytes_per_pixel;
+            changed = !capture->valid;
+            for (row = 0; row < h; row++) {
+                copy(tile + row * len, mem + (size_t)(y + row) * stride + x * bytes_per_pixel,
+                     len);
+                if (!changed)
+                    changed = memcmp(tile + row * len, snap + (size_t)row * width *
+                                     bytes_per_pixel, len) != 0;
+            }
+            if (!changed)
+                continue;
+
+            for (row = 0; row < h; row++)
+                memcpy(snap + (size_t)row * width * bytes_per_pixel, tile + row * len, len);
+            p = tile + h * len;
+            n++;
+        }
+    }
+    capture->valid = 1;
+
+    put16(put16(put16(put16(put16(capture->out, width), height), bytes_per_pixel),
+                FBCAPTURE_TILE), n);
+    return p - capture->out;
+}
+
+/* Like fbcapture_tiles() when the image can't be read, e.g. because another
+ * console is shown: the last capture is taken again, which has no changes,
+ * or all its tiles after fbcapture_reset().  Without a last capture of this
+ * size there are no tiles.
+ */
+size_t fbcapture_repeat(FBCapture *capture, int width, int height, int bytes_per_pixel)
+{
+    if (capture->snapshot && width == capture->width && height == capture->height &&
+        bytes_per_pixel == capture->bytes_per_pixel)
+        return fbcapture_tiles(capture, capture->snapshot, width * bytes_per_pixel,
+                               width, height, bytes_per_pixel, 0);
+
+    fbcapture_free(capture);
+    capture->out = malloc(10);
+    if (!capture->out)
+        return 0;
+    put16(put16(put16(put16(put16(capture->out, width), height), bytes_per_pixel),
+                FBCAPTURE_TILE), 0);
+    return 10;
+}
@@ -0,0 +1,55 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbcapture.h - Framebuffer capture
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FBCAPTURE_H_
+#define _FBCAPTURE_H_
+
+#include <stddef.h>
+
+#define FBCAPTURE_TILE 32
+
+// The last capture, to send only the tiles that changed since.
+typedef struct {
+    int width, height, bytes_per_pixel;
+    int valid;                  // whether snapshot holds the last capture
+    unsigned char *snapshot;    // width * bytes_per_pixel bytes per line
+    unsigned char *out;         // the encoded changes, see fbcapture.c
+    size_t out_size;
+} FBCapture;
+
+size_t fbcapture_tiles(FBCapture *capture, const unsigned char *mem, int stride,
+                       int width, int height, int bytes_per_pixel, int uncached);
+size_t fbcapture_repeat(FBCapture *capture, int width, int height, int bytes_per_pixel);
+void fbcapture_reset(FBCapture *capture);
+void fbcapture_free(FBCapture *capture);
+
+#endif
@@ -0,0 +1,238 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbdamage.c - Framebuffer damage detection
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fbdamage.h"
+
+/* Tiles are hashed with NH (as in UMAC): pairs of pixels plus a key for
+ * their position are multiplied and the 64 bit products summed.  It needs
+ * one multiply per two pixels, vectorizes with SSE2 and moving the same
+ * pixels somewhere else changes the hash.  Two hashes with keys shifted by
+ * four make accidental collisions very unlikely.  The keys are fixed, so
+ * this is a fast non-cryptographic hash: a changed tile built to collide
+ * on purpose is not detected.
+ */
+static uint32_t nh_keys[FBDAMAGE_TILE * FBDAMAGE_TILE + 4];
+static int nh_keys_ready = 0;
+
+static void nh_init(void)
+{
+    uint32_t x = 0x9e3779b9;
+    int i;
+
+    for (i = 0; i < FBDAMAGE_TILE * FBDAMAGE_TILE + 4; i++) {
+        // xorshift32
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        nh_keys[i] = x;
+    }
+    nh_keys_ready = 1;
+}
+
+static void hash_tile(FBSource *src, int x, int y, int w, int h, uint64_t *out)
+{
+    const uint32_t *p, *k;
+    uint64_t h1 = 0, h2 = 0;
+    uint32_t a0, a1, b0, b1;
+    int row, i;
+#ifdef __SSE2__
+    __m128i v1 = _mm_setzero_si128(), v2 = _mm_setzero_si128();
+    uint64_t lanes[2];
+#endif
+
+    for (row = 0; row < h; row++) {
+        p = src->pixels + (y + row) * src->stride + x;
+        k = nh_keys + row * FBDAMAGE_TILE;
+        i = 0;
+#ifdef __SSE2__
+        for (; i + 4 <= w; i += 4) {
+            __m128i px = _mm_loadu_si128((const __m128i *)(p + i));
+            __m128i a = _mm_add_epi32(px, _mm_loadu_si128((const __m128i *)(k + i)));
+            __m128i b = _mm_add_epi32(px, _mm_loadu_si128((const __m128i *)(k + i + 4)));
+            v1 = _mm_add_epi64(v1, _mm_mul_epu32(a, _mm_srli_epi64(a, 32)));
+            v2 = _mm_add_epi64(v2, _mm_mul_epu32(b, _mm_srli_epi64(b, 32)));
+        }
+#endif
+        for (; i < w; i += 2) {
+            a0 = p[i] + k[i];
+            b0 = p[i] + k[i + 4];
+            a1 = (i + 1 < w ? p[i + 1] : 0) + k[i + 1];
+            b1 = (i + 1 < w ? p[i + 1] : 0) + k[i + 5];
+            h1 += (uint64_t)a0 * a1;
+            h2 += (uint64_t)b0 * b1;
+        }
+    }
+#ifdef __SSE2__
+    _mm_storeu_si128((__m128i *)lanes, v1);
+    h1 += lanes[0] + lanes[1];
+    _mm_storeu_si128((__m128i *)lanes, v2);
+    h2 += lanes[0] + lanes[1];
+#endif
+    out[0] = h1;
+    out[1] = h2;
+}
+
+/* Forget the last frame, so the next one is copied completely. */
+void fbdamage_reset(FBDamage *damage)
+{
+    if (damage->valid)
+        memset(damage->valid, 0, damage->tiles_x * damage->tiles_y);
+}
+
+void fbdamage_free(FBDamage *damage)
+{
+    free(damage->hashes);
+    free(damage->valid);
+    damage->hashes = NULL;
+    damage->valid = NULL;
+    damage->width = damage->height = 0;
+}
+
+/* Compare the tiles of the source with the last frame.  Runs of changed
+ * tiles on a tile row are returned as rects (x, y, w, h) in a new array;
+ * the return value is their number, or -1 if everything changed or the
+ * memory for the hashes isn't available.
+ */
+int fbdamage_detect(FBDamage *damage, FBSource *src, int dst_x, int dst_y, int **rects)
+{
+    uint64_t hash[2], *old;
+    int tx, ty, x, y, w, h, n = 0, run, changed, all = 1, *r;
+
+    *rects = NULL;
+    if (!nh_keys_ready)
+        nh_init();
+
+    if (src->width != damage->width || src->height != damage->height ||
+        dst_x != damage->dst_x || dst_y != damage->dst_y) {
+        fbdamage_free(damage);
+        damage->tiles_x = (src->width + FBDAMAGE_TILE - 1) / FBDAMAGE_TILE;
+        damage->tiles_y = (src->height + FBDAMAGE_TILE - 1) / FBDAMAGE_TILE;
+        damage->hashes = malloc(sizeof(uint64_t) * 2 * damage->tiles_x * damage->tiles_y);
+        damage->valid = calloc(damage->tiles_x * damage->tiles_y, 1);
+        if (!damage->hashes || !damage->valid) {
+            fbdamage_free(damage);
+            return -1;
+        }
+        damage->width = src->width;
+        damage->height = src->height;
+        damage->dst_x = dst_x;
+        damage->dst_y = dst_y;
+    }
+
+    // At worst every other tile of a row changed.
+    r = malloc(sizeof(int) * 4 * damage->tiles_y * ((damage->tiles_x + 1) / 2));
+    if (!r) {
+        fbdamage_reset(damage);
+        return -1;
+    }
+
+    for (ty = 0; ty < damage->tiles_y; ty++) {
+        y = ty * FBDAMAGE_TILE;
+        h = src->height - y < FBDAMAGE_TILE ? src->height - y : FBDAMAGE_TILE;
+        run = -1;
+        for (tx = 0; tx <= damage->tiles_x; tx++) {
+            changed = 0;
+            if (tx < damage->tiles_x) {
+                x = tx * FBDAMAGE_TILE;
+                w = src->width - x < FBDAMAGE_TILE ? src->width - x : FBDAMAGE_TILE;
+                hash_tile(src, x, y, w, h, hash);
+                old = damage->hashes + 2 * (ty * damage->tiles_x + tx);
+                changed = !damage->valid[ty * damage->tiles_x + tx] ||
+                          old[0] != hash[0] || old[1] != hash[1];
+                old[0] = hash[0];
+                old[1] = hash[1];
+                damage->valid[ty * damage->tiles_x + tx] = 1;
+                damage->tiles++;
+                if (!changed) {
+                    damage->skipped++;
+                    all = 0;
+                }
+            }
+            if (changed && run < 0)
+                run = tx;
+            else if (!changed && run >= 0) {
+                // a run of changed tiles ended
+                r[n * 4] = run * FBDAMAGE_TILE;
+                r[n * 4 + 1] = y;
+                r[n * 4 + 2] = (tx * FBDAMAGE_TILE < src->width ? tx * FBDAMAGE_TILE :
+                                src->width) - run * FBDAMAGE_TILE;
+                r[n * 4 + 3] = h;
+                n++;
+                run = -1;
+            }
+        }
+    }
+    damage->frames++;
+
+    if (all) {
+        free(r);
+        return -1;
+    }
+    *rects = r;
+    return n;
+}
+
+/* The given rects (x, y, w, h) were copied without looking at the tiles,
+ * so the hashes of the tiles they touch are no longer those on screen.
+ */
+void fbdamage_invalidate(FBDamage *damage, const int *rects, int n_rects)
+{
+    int i, tx, ty, x0, y0, x1, y1;
+
+    if (!damage->valid)
+        return;
+    if (n_rects < 0) {
+        fbdamage_reset(damage);
+        return;
+    }
+    for (i = 0; i < n_rects; i++, rects += 4) {
+        if (rects[2] <= 0 || rects[3] <= 0)
+            continue;
+        x0 = rects[0] < 0 ? 0 : rects[0] / FBDAMAGE_TILE;
+        y0 = rects[1] < 0 ? 0 : rects[1] / FBDAMAGE_TILE;
+        x1 = (rects[0] + rects[2] - 1) / FBDAMAGE_TILE;
+        y1 = (rects[1] + rects[3] - 1) / FBDAMAGE_TILE;
+        if (x1 >= damage->tiles_x)
+            x1 = damage->tiles_x - 1;
+        if (y1 >= damage->tiles_y)
+            y1 = damage->tiles_y - 1;
+        for (ty = y0; ty <= y1; ty++)
+            for (tx = x0; tx <= x1; tx++)
+                damage->valid[ty * damage->tiles_x + tx] = 0;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbdamage.h - Framebuffer damage detection
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FBDAMAGE_H_
+#define _FBDAMAGE_H_
+
+#include <stdint.h>
+#include "fbblit.h"
+
+#define FBDAMAGE_TILE 64
+
+// Hashes of the tiles of the last frame, to find the ones that changed.
+typedef struct {
+    int width, height;      // size of the source, 0 if nothing is known
+    int dst_x, dst_y;       // where it was placed
+    int tiles_x, tiles_y;
+    uint64_t *hashes;       // two per tile
+    unsigned char *valid;   // whether the hashes of a tile are known
+
+    // statistics
+    uint64_t frames, tiles, skipped;
+} FBDamage;
+
+void fbdamage_reset(FBDamage *damage);
+void fbdamage_free(FBDamage *damage);
+int fbdamage_detect(FBDamage *damage, FBSource *src, int dst_x, int dst_y, int **rects);
+void fbdamage_invalidate(FBDamage *damage, const int *rects, int n_rects);
+
+#endif
@@ -0,0 +1,596 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbinput.c - Framebuffer keyboard and mouse input
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include <Python.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "fbinput.h"
+
+/* Events are read straight from evdev devices and turned into the signals
+ * X11Window emits, so code written for X11 works unchanged: keys are
+ * mapped to X keysyms (US layout) and named like X11Display.handle_events
+ * does, button and modifier states are X11 masks.
+ */
+
+#define FBINPUT_BATCH 64        // events per read()
+#define FBINPUT_MAX_BATCHES 16  // reads before returning to the main loop
+
+// X11 modifier and button masks
+#define SHIFT_MASK      (1 << 0)
+#define LOCK_MASK       (1 << 1)
+#define CONTROL_MASK    (1 << 2)
+#define MOD1_MASK       (1 << 3)
+#define MOD2_MASK       (1 << 4)
+#define MOD4_MASK       (1 << 6)
+#define BUTTON_MASK(n)  (1 << (7 + (n)))
+
+// Bits of FBInput_PyObject.held, the buttons use BUTTON_MASK
+enum {
+    FBINPUT_SHIFT = 0x03,
+    FBINPUT_CTRL = 0x0c,
+    FBINPUT_ALT = 0x30,
+    FBINPUT_META = 0xc0
+};
+
+enum {
+    KEY_LETTER = 1,     // caps lock works like shift
+    KEY_KEYPAD = 2      // num lock selects the shifted keysym
+};
+
+typedef struct {
+    uint16_t keysym, shifted;
+    int flags;
+} FBKeysym;
+
+#define LETTER(c) { c, c - 'a' + 'A', KEY_LETTER }
+#define KEYPAD(k, n) { k, n, KEY_KEYPAD }
+
+static const FBKeysym keymap[KEY_COMPOSE + 1] = {
+    [KEY_ESC] = { 0xff1b },
+    [KEY_1] = { '1', '!' }, [KEY_2] = { '2', '@' }, [KEY_3] = { '3', '#' },
+    [KEY_4] = { '4', '$' }, [KEY_5] = { '5', '%' }, [KEY_6] = { '6', '^' },
+    [KEY_7] = { '7', '&' }, [KEY_8] = { '8', '*' }, [KEY_9] = { '9', '(' },
+    [KEY_0] = { '0', ')' }, [KEY_MINUS] = { '-', '_' }, [KEY_EQUAL] = { '=', '+' },
+    [KEY_BACKSPACE] = { 0xff08 }, [KEY_TAB] = { 0xff09 },
+    [KEY_Q] = LETTER('q'), [KEY_W] = LETTER('w'), [KEY_E] = LETTER('e'),
+    [KEY_R] = LETTER('r'), [KEY_T] = LETTER('t'), [KEY_Y] = LETTER('y'),
+    [KEY_U] = LETTER('u'), [KEY_I] = LETTER('i'), [KEY_O] = LETTER('o'),
+    [KEY_P] = LETTER('p'), [KEY_LEFTBRACE] = { '[', '{' },
+    [KEY_RIGHTBRACE] = { ']', '}' }, [KEY_ENTER] = { 0xff0d },
+    [KEY_LEFTCTRL] = { 0xffe3 },
+    [KEY_A] = LETTER('a'), [KEY_S] = LETTER('s'), [KEY_D] = LETTER('d'),
+    [KEY_F] = LETTER('f'), [KEY_G] = LETTER('g'), [KEY_H] = LETTER('h'),
+    [KEY_J] = LETTER('j'), [KEY_K] = LETTER('k'), [KEY_L] = LETTER('l'),
+    [KEY_SEMICOLON] = { ';', ':' }, [KEY_APOSTROPHE] = { '\'', '"' },
+    [KEY_GRAVE] = { '`', '~' }, [KEY_LEFTSHIFT] = { 0xffe1 },
+    [KEY_BACKSLASH] = { '\\', '|' },
+    [KEY_Z] = LETTER('z'), [KEY_X] = LETTER('x'), [KEY_C] = LETTER('c'),
+    [KEY_V] = LETTER('v'), [KEY_B] = LETTER('b'), [KEY_N] = LETTER('n'),
+    [KEY_M] = LETTER('m'), [KEY_COMMA] = { ',', '<' }, [KEY_DOT] = { '.', '>' },
+    [KEY_SLASH] = { '/', '?' }, [KEY_RIGHTSHIFT] = { 0xffe2 },
+    [KEY_KPASTERISK] = { 0xffaa }, [KEY_LEFTALT] = { 0xffe9 },
+    [KEY_SPACE] = { ' ' }, [KEY_CAPSLOCK] = { 0xffe5 },
+    [KEY_F1] = { 0xffbe }, [KEY_F2] = { 0xffbf }, [KEY_F3] = { 0xffc0 },
+    [KEY_F4] = { 0xffc1 }, [KEY_F5] = { 0xffc2 }, [KEY_F6] = { 0xffc3 },
+    [KEY_F7] = { 0xffc4 }, [KEY_F8] = { 0xffc5 }, [KEY_F9] = { 0xffc6 },
+    [KEY_F10] = { 0xffc7 }, [KEY_NUMLOCK] = { 0xff7f },
+    [KEY_SCROLLLOCK] = { 0xff14 },
+    [KEY_KP7] = KEYPAD(0xff95, 0xffb7), [KEY_KP8] = KEYPAD(0xff97, 0xffb8),
+    [KEY_KP9] = KEYPAD(0xff9a, 0xffb9), [KEY_KPMINUS] = { 0xffad },
+    [KEY_KP4] = KEYPAD(0xff96, 0xffb4), [KEY_KP5] = KEYPAD(0xff9d, 0xffb5),
+    [KEY_KP6] = KEYPAD(0xff98, 0xffb6), [KEY_KPPLUS] = { 0xffab },
+    [KEY_KP1] = KEYPAD(0xff9c, 0xffb1), [KEY_KP2] = KEYPAD(0xff99, 0xffb2),
+    [KEY_KP3] = KEYPAD(0xff9b, 0xffb3), [KEY_KP0] = KEYPAD(0xff9e, 0xffb0),
+    [KEY_KPDOT] = KEYPAD(0xff9f, 0xffae),
+    [KEY_102ND] = { '<', '>' }, [KEY_F11] = { 0xffc8 }, [KEY_F12] = { 0xffc9 },
+    [KEY_KPENTER] = { 0xff8d }, [KEY_RIGHTCTRL] = { 0xffe4 },
+    [KEY_KPSLASH] = { 0xffaf }, [KEY_SYSRQ] = { 0xff61 },
+    [KEY_RIGHTALT] = { 0xffea }, [KEY_HOME] = { 0xff50 }, [KEY_UP] = { 0xff52 },
+    [KEY_PAGEUP] = { 0xff55 }, [KEY_LEFT] = { 0xff51 }, [KEY_RIGHT] = { 0xff53 },
+    [KEY_END] = { 0xff57 }, [KEY_DOWN] = { 0xff54 }, [KEY_PAGEDOWN] = { 0xff56 },
+    [KEY_INSERT] = { 0xff63 }, [KEY_DELETE] = { 0xffff },
+    [KEY_KPEQUAL] = { 0xffbd }, [KEY_PAUSE] = { 0xff13 },
+    [KEY_LEFTMETA] = { 0xffeb }, [KEY_RIGHTMETA] = { 0xffec },
+    [KEY_COMPOSE] = { 0xff67 }
+};
+
+// Names for keys as folded by X11Display.handle_events (see x11.py)
+static const char *key_names[512] = {
+    [338] = "up", [340] = "down", [337] = "left", [339] = "right",
+    [446] = "F1", [447] = "F2", [448] = "F3", [449] = "F4", [450] = "F5",
+    [451] = "F6", [452] = "F7", [453] = "F8", [454] = "F9", [455] = "F10",
+    [456] = "F11", [457] = "F12",
+    [355] = "ins", [511] = "del", [336] = "home", [343] = "end",
+    [283] = "esc", [269] = "enter", [264] = "backspace", [32] = "space",
+    [489] = "left-alt", [490] = "right-alt", [483] = "left-ctrl",
+    [484] = "right-ctrl", [481] = "left-shift", [482] = "right-shift",
+    [359] = "menu", [275] = "pause",
+    [427] = "kp_plus", [429] = "kp_minus"
+};
+
+
+static unsigned int fbinput_state(FBInput_PyObject *self)
+{
+    unsigned int state = self->held & (BUTTON_MASK(1) * 0x1f);
+
+    if (self->held & FBINPUT_SHIFT)
+        state |= SHIFT_MASK;
+    if (self->caps_lock)
+        state |= LOCK_MASK;
+    if (self->held & FBINPUT_CTRL)
+        state |= CONTROL_MASK;
+    if (self->held & FBINPUT_ALT)
+        state |= MOD1_MASK;
+    if (self->num_lock)
+        state |= MOD2_MASK;
+    if (self->held & FBINPUT_META)
+        state |= MOD4_MASK;
+    return state;
+}
+
+
+/* Return the key for an evdev key code like X11Window passes it: a name,
+ * a character or the folded keysym.  NULL for unknown keys.
+ */
+static PyObject *fbinput_key(FBInput_PyObject *self, int code)
+{
+    const FBKeysym *k;
+    int keysym, shift, key;
+    char c;
+
+    if (code < 0 || code > KEY_COMPOSE || !keymap[code].keysym)
+        return NULL;
+    k = &keymap[code];
+
+    shift = (self->held & FBINPUT_SHIFT) != 0;
+    if (k->flags & KEY_LETTER)
+        shift ^= self->caps_lock;
+    else if (k->flags & KEY_KEYPAD)
+        shift = self->num_lock;
+    keysym = shift && k->shifted ? k->shifted : k->keysym;
+
+    // the same folding as in x11display.c
+    key = (keysym & 0xff00) != 0 ? (keysym & 0x00ff) + 256 : keysym;
+    if (key_names[key])
+        return PyString_FromString(key_names[key]);
+    if (key < 255) {
+        c = key;
+        return PyString_FromStringAndSize(&c, 1);
+    }
+    return PyInt_FromLong(key);
+}
+
+
+static int fbinput_modifier(int code)
+{
+    switch (code) {
+    case KEY_LEFTSHIFT: return 0x01;
+    case KEY_RIGHTSHIFT: return 0x02;
+    case KEY_LEFTCTRL: return 0x04;
+    case KEY_RIGHTCTRL: return 0x08;
+    case KEY_LEFTALT: return 0x10;
+    case KEY_RIGHTALT: return 0x20;
+    case KEY_LEFTMETA: return 0x40;
+    case KEY_RIGHTMETA: return 0x80;
+    }
+    return 0;
+}
+
+
+static int fbinput_button(int code)
+{
+    switch (code) {
+    case BTN_LEFT: case BTN_TOUCH: return 1;
+    case BTN_MIDDLE: return 2;
+    case BTN_RIGHT: return 3;
+    case BTN_SIDE: return 8;
+    case BTN_EXTRA: return 9;
+    }
+    return 0;
+}
+
+
+/* Append (signal, args) to events.  Returns -1 with an exception set if
+ * that or building args failed.
+ */
+static int fbinput_append(PyObject *events, const char *signal, PyObject *args)
+{
+    PyObject *o;
+    int err;
+
+    if (!args)
+        return -1;
+    o = Py_BuildValue("(sN)", signal, args);
+    if (!o)
+        return -1;
+    err = PyList_Append(events, o);
+    Py_DECREF(o);
+    return err;
+}
+
+
+static int fbinput_button_event(FBInput_PyObject *self, int button, int press,
+                                PyObject *events)
+{
+    int err;
+
+    // the state is the one before the event, as in X11
+    err = fbinput_append(events, press ? "button_press_event" : "button_release_event",
+                         Py_BuildValue("((ii)ii)", self->x, self->y,
+                                       fbinput_state(self), button));
+    if (button <= 5) {
+        if (press)
+            self->held |= BUTTON_MASK(button);
+        else
+            self->held &= ~BUTTON_MASK(button);
+    }
+    return err;
+}
+
+
+static int fbinput_clamp(int v, int max)
+{
+    return v < 0 ? 0 : v >= max ? max - 1 : v;
+}
+
+
+/* Append the signals for one event to events.  Returns -1 with an
+ * exception set on errors.
+ */
+static int fbinput_event(FBInput_PyObject *self, FBInputDevice *dev,
+                         const struct input_event *ev, PyObject *events)
+{
+    PyObject *key;
+    int button, modifier, axis, v, err = 0;
+
+    if (ev->type == EV_KEY) {
+        // value: 0 release, 1 press, 2 autorepeat
+        if ((button = fbinput_button(ev->code)) != 0) {
+            if (ev->value != 2)
+                return fbinput_button_event(self, button, ev->value, events);
+            return 0;
+        }
+        if ((key = fbinput_key(self, ev->code)) != NULL)
+            err = fbinput_append(events, ev->value ? "key_press_event" : "key_release_event",
+                                 Py_BuildValue("(N)", key));
+        else if (PyErr_Occurred())
+            err = -1;
+        if (ev->value == 1 && ev->code == KEY_CAPSLOCK)
+            self->caps_lock = !self->caps_lock;
+        if (ev->value == 1 && ev->code == KEY_NUMLOCK)
+            self->num_lock = !self->num_lock;
+        if ((modifier = fbinput_modifier(ev->code)) != 0) {
+            if (ev->value)
+                self->held |= modifier;
+            else
+                self->held &= ~modifier;
+        }
+    }
+    else if (ev->type == EV_REL) {
+        if (ev->code == REL_X)
+            self->x = fbinput_clamp(self->x + ev->value, self->width);
+        else if (ev->code == REL_Y)
+            self->y = fbinput_clamp(self->y + ev->value, self->height);
+        else if (ev->code == REL_WHEEL || ev->code == REL_HWHEEL) {
+            // X11 reports wheels as clicks of buttons 4 to 7
+            button = ev->code == REL_WHEEL ? (ev->value > 0 ? 4 : 5)
+                                           : (ev->value > 0 ? 7 : 6);
+            for (v = abs(ev->value); v > 0 && !err; v--) {
+                err = fbinput_button_event(self, button, 1, events);
+                if (!err)
+                    err = fbinput_button_event(self, button, 0, events);
+            }
+        }
+    }
+    else if (ev->type == EV_ABS && (ev->code == ABS_X || ev->code == ABS_Y)) {
+        axis = ev->code == ABS_Y;
+        v = ev->value;
+        if (dev->abs_max[axis] > dev->abs_min[axis])
+            v = (long long)(v - dev->abs_min[axis]) * ((axis ? self->height : self->width) - 1) /
+                (dev->abs_max[axis] - dev->abs_min[axis]);
+        if (axis)
+            self->y = fbinput_clamp(v, self->height);
+        else
+            self->x = fbinput_clamp(v, self->width);
+    }
+    return err;
+}
+
+
+/* Read what is available from a device in batches and append the signals
+ * to events.  Returns 0 at the end of the file or when the device is gone,
+ * 1 otherwise and -1 on errors.
+ */
+static int fbinput_read(FBInput_PyObject *self, FBInputDevice *dev, PyObject *events)
+{
+    struct input_event buf[FBINPUT_BATCH];
+    const int size = sizeof(struct input_event);
+    int batch, len, n, i, err = 0;
+
+    for (batch = 0; batch < FBINPUT_MAX_BATCHES; batch++) {
+        memcpy(buf, &dev->partial, dev->pending);
+        len = read(dev->fd, (char *)buf + dev->pending, sizeof(buf) - dev->pending);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return 1;
+            if (errno == ENODEV)
+                return 0;
+            PyErr_Format(PyExc_SystemError, "unable to read input: %s", strerror(errno));
+            return -1;
+        }
+        if (len == 0)
+            return 0;
+
+        len += dev->pending;
+        n = len / size;
+        for (i = 0; i < n && !err; i++)
+            err = fbinput_event(self, dev, &buf[i], events);
+        // Keep a partial event even on errors, so the next read is aligned.
+        dev->pending = len - n * size;
+        memcpy(&dev->partial, &buf[n], dev->pending);
+        if (err)
+            return -1;
+
+        if (len < (int)sizeof(buf))
+            return 1;
+    }
+    return 1;
+}
+
+
+static FBInputDevice *fbinput_device(FBInput_PyObject *self, int fd)
+{
+    int i;
+
+    for (i = 0; i < self->n_devices; i++)
+        if (self->devices[i].fd == fd)
+            return &self->devices[i];
+    PyErr_Format(PyExc_ValueError, "no input device with fd %d", fd);
+    return NULL;
+}
+
+
+static void fbinput_close(FBInput_PyObject *self, FBInputDevice *dev)
+{
+    close(dev->fd);
+    *dev = self->devices[--self->n_devices];
+}
+
+
+PyObject *
+FBInput_PyObject__new(PyTypeObject *type, PyObject * args, PyObject * kwargs)
+{
+    FBInput_PyObject *self;
+    int width, height;
+
+    if (!PyArg_ParseTuple(args, "(ii)", &width, &height))
+        return NULL;
+    if (width <= 0 || height <= 0) {
+        PyErr_Format(PyExc_ValueError, "invalid size");
+        return NULL;
+    }
+
+    self = (FBInput_PyObject *)type->tp_alloc(type, 0);
+    if (!self)
+        return NULL;
+    self->width = width;
+    self->height = height;
+    self->x = width / 2;
+    self->y = height / 2;
+    return (PyObject *)self;
+}
+
+
+void
+FBInput_PyObject__dealloc(FBInput_PyObject * self)
+{
+    while (self->n_devices)
+        fbinput_close(self, &self->devices[0]);
+    self->ob_type->tp_free((PyObject*)self);
+}
+
+
+/* Open an input device and return its fd, which becomes readable when
+ * there are events.  Anything but an evdev device is read as a recording
+ * of input_event structs.  With grab, nobody else gets the events.
+ */
+PyObject *
+FBInput_PyObject__open(FBInput_PyObject * self, PyObject * args)
+{
+    FBInputDevice *dev;
+    struct input_absinfo abs;
+    unsigned char leds[(LED_MAX + 8) / 8];
+    char *path;
+    int grab = 0, fd, i;
+
+    if (!PyArg_ParseTuple(args, "s|i", &path, &grab))
+        return NULL;
+
+    if (self->n_devices == FBINPUT_MAX_DEVICES) {
+        PyErr_Format(PyExc_SystemError, "too many input devices");
+        return NULL;
+    }
+
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) {
+        PyErr_Format(PyExc_SystemError, "unable to open input device %s: %s", path,
+                     strerror(errno));
+        return NULL;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (grab && ioctl(fd, EVIOCGRAB, 1) < 0 && errno != ENOTTY && errno != EINVAL) {
+        PyErr_Format(PyExc_SystemError, "unable to grab input device %s: %s", path,
+                     strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    dev = &self->devices[self->n_devices++];
+    memset(dev, 0, sizeof(*dev));
+    dev->fd = fd;
+    for (i = 0; i < 2; i++) {
+        if (ioctl(fd, EVIOCGABS(ABS_X + i), &abs) == 0) {
+            dev->abs_min[i] = abs.minimum;
+            dev->abs_max[i] = abs.maximum;
+        }
+    }
+
+    // start with the lock states the keyboard shows
+    memset(leds, 0, sizeof(leds));
+    if (ioctl(fd, EVIOCGBIT(EV_LED, sizeof(leds)), leds) > 0 &&
+        (leds[LED_NUML / 8] >> (LED_NUML % 8)) & 1 &&
+        ioctl(fd, EVIOCGLED(sizeof(leds)), leds) >= 0) {
+        self->num_lock = (leds[LED_NUML / 8] >> (LED_NUML % 8)) & 1;
+        self->caps_lock = (leds[LED_CAPSL / 8] >> (LED_CAPSL % 8)) & 1;
+    }
+
+    return Py_BuildValue("i", fd);
+}
+
+
+/* Read the events of the device with the given fd.  Returns a list of
+ * (signal name, arguments) and whether the device is still open; it is
+ * closed at the end of the file.
+ */
+PyObject *
+FBInput_PyObject__read(FBInput_PyObject * self, PyObject * args)
+{
+    FBInputDevice *dev;
+    PyObject *events;
+    int fd, alive;
+
+    if (!PyArg_ParseTuple(args, "i", &fd))
+        return NULL;
+    if (!(dev = fbinput_device(self, fd)))
+        return NULL;
+
+    events = PyList_New(0);
+    if (!events)
+        return NULL;
+    alive = fbinput_read(self, dev, events);
+    if (alive < 0) {
+        Py_DECREF(events);
+        return NULL;
+    }
+    if (!alive)
+        fbinput_close(self, dev);
+    return Py_BuildValue("(NO)", events, alive ? Py_True : Py_False);
+}
+
+
+PyObject *
+FBInput_PyObject__close(FBInput_PyObject * self, PyObject * args)
+{
+    FBInputDevice *dev;
+    int fd = -1;
+
+    if (!PyArg_ParseTuple(args, "|i", &fd))
+        return NULL;
+    if (fd < 0) {
+        while (self->n_devices)
+            fbinput_close(self, &self->devices[0]);
+    } else {
+        if (!(dev = fbinput_device(self, fd)))
+            return NULL;
+        fbinput_close(self, dev);
+    }
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+PyObject *
+FBInput_PyObject__get_pointer(FBInput_PyObject * self, PyObject * args)
+{
+    return Py_BuildValue("(ii)", self->x, self->y);
+}
+
+
+PyMethodDef FBInput_PyObject_methods[] = {
+    { "open", ( PyCFunction ) FBInput_PyObject__open, METH_VARARGS },
+    { "read", ( PyCFunction ) FBInput_PyObject__read, METH_VARARGS },
+    { "close", ( PyCFunction ) FBInput_PyObject__close, METH_VARARGS },
+    { "get_pointer", ( PyCFunction ) FBInput_PyObject__get_pointer, METH_VARARGS },
+    { NULL, NULL }
+};
+
+
+PyTypeObject FBInput_PyObject_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                         /*ob_size*/
+    "Input",                   /*tp_name*/
+    sizeof(FBInput_PyObject),  /*tp_basicsize*/
+    0,                         /*tp_itemsize*/
+    (destructor)FBInput_PyObject__dealloc, /* tp_dealloc */
+    0,                         /*tp_print*/
+    0,                         /* tp_getattr */
+    0,                         /* tp_setattr */
+    0,                         /*tp_compare*/
+    0,                         /*tp_repr*/
+    0,                         /*tp_as_number*/
+    0,                         /*tp_as_sequence*/
+    0,                         /*tp_as_mapping*/
+    0,                         /*tp_hash */
+    0,                         /*tp_call*/
+    0,                         /*tp_str*/
+    PyObject_GenericGetAttr,   /*tp_getattro*/
+    PyObject_GenericSetAttr,   /*tp_setattro*/
+    0,                         /*tp_as_buffer*/
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE, /*tp_flags*/
+    "Framebuffer Input Devices", /* tp_doc */
+    0,   /* tp_traverse */
+    0,           /* tp_clear */
+    0,                     /* tp_richcompare */
+    0,                     /* tp_weaklistoffset */
+    0,                     /* tp_iter */
+    0,                     /* tp_iternext */
+    FBInput_PyObject_methods,  /* tp_methods */
+    0,                         /* tp_members */
+    0,                         /* tp_getset */
+    0,                         /* tp_base */
+    0,                         /* tp_dict */
+    0,                         /* tp_descr_get */
+    0,                         /* tp_descr_set */
+    0,                         /* tp_dictoffset */
+    0,                         /* tp_init */
+    0,                         /* tp_alloc */
+    FBInput_PyObject__new,     /* tp_new */
+};
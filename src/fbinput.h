@@ -0,0 +1,64 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbinput.h - Framebuffer keyboard and mouse input
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FBINPUT_H_
+#define _FBINPUT_H_
+
+#include <Python.h>
+#include <linux/input.h>
+
+#define FBINPUT_MAX_DEVICES 16
+
+typedef struct {
+    int fd;
+    // Pipes may return part of an event; it is completed by the next read.
+    int pending;
+    struct input_event partial;
+    // Range of ABS_X and ABS_Y for touchscreens, max <= min if unknown.
+    int abs_min[2], abs_max[2];
+} FBInputDevice;
+
+typedef struct {
+    PyObject_HEAD
+
+    FBInputDevice devices[FBINPUT_MAX_DEVICES];
+    int n_devices;
+
+    int width, height;      // the pointer stays inside this area
+    int x, y;
+    unsigned int held;      // modifier keys and buttons down, FBINPUT_*
+    int caps_lock, num_lock;
+} FBInput_PyObject;
+
+extern PyTypeObject FBInput_PyObject_Type;
+
+#endif
@@ -0,0 +1,342 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbscale.c - Framebuffer scaling
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fbscale.h"
+
+/* Source position for each destination column or line, with the pixel
+ * centers lined up.  For bilinear filtering the weight of the next source
+ * pixel is in 1/256.
+ */
+static void build_axis(int filter, int src, int dst, int *index, int *weights)
+{
+    long long pos;
+    int i;
+
+    for (i = 0; i < dst; i++) {
+        if (filter == FBSCALE_NEAREST) {
+            index[i] = (int)((2LL * i + 1) * src / (2LL * dst));
+            continue;
+        }
+        // in 1/256 source pixels
+        pos = (2LL * i + 1) * src * 128 / dst - 128;
+        if (pos < 0) {
+            index[i] = 0;
+            weights[i] = 0;
+        } else if (pos >= (long long)(src - 1) * 256) {
+            index[i] = src - 1;
+            weights[i] = 0;
+        } else {
+            index[i] = (int)(pos >> 8);
+            weights[i] = (int)(pos & 255);
+        }
+    }
+}
+
+void fbscale_free(FBScale *scale)
+{
+    free(scale->x_index);
+    free(scale->y_index);
+    free(scale->x_weights);
+    free(scale->y_weights);
+    memset(scale, 0, sizeof(FBScale));
+}
+
+/* Prepare the tables for scaling a src_w x src_h image into the given rect.
+ * They are kept as long as the sizes stay the same.  Returns 1 if they
+ * changed, 0 if not and -1 if out of memory.
+ */
+int fbscale_setup(FBScale *scale, int filter, int src_w, int src_h,
+                  int dst_x, int dst_y, int dst_w, int dst_h)
+{
+    int i;
+
+    if (scale->x_index && scale->filter == filter && scale->src_w == src_w &&
+        scale->src_h == src_h && scale->dst_x == dst_x && scale->dst_y == dst_y &&
+        scale->dst_w == dst_w && scale->dst_h == dst_h)
+        return 0;
+
+    fbscale_free(scale);
+    if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0)
+        return -1;
+    scale->x_index = malloc(sizeof(int) * dst_w);
+    scale->y_index = malloc(sizeof(int) * dst_h);
+    scale->y_weights = malloc(sizeof(int) * dst_h);
+    scale->x_weights = malloc(sizeof(int16_t) * 8 * dst_w);
+    if (!scale->x_index || !scale->y_index || !scale->y_weights || !scale->x_weights) {
+        fbscale_free(scale);
+        return -1;
+    }
+
+    // x_weights is used as temporary storage for the column weights.
+    build_axis(filter, src_w, dst_w, scale->x_index, (int *)scale->x_weights);
+    build_axis(filter, src_h, dst_h, scale->y_index, scale->y_weights);
+    for (i = dst_w - 1; filter == FBSCALE_BILINEAR && i >= 0; i--) {
+        int w = ((int *)scale->x_weights)[i];
+        int16_t *v = scale->x_weights + i * 8;
+        v[0] = v[1] = v[2] = v[3] = 256 - w;
+        v[4] = v[5] = v[6] = v[7] = w;
+    }
+
+    scale->filter = filter;
+    scale->src_w = src_w;
+    scale->src_h = src_h;
+    scale->dst_x = dst_x;
+    scale->dst_y = dst_y;
+    scale->dst_w = dst_w;
+    scale->dst_h = dst_h;
+    return 1;
+}
+
+/* (a * (256 - w) + b * w) / 256 for n pixels */
+static void blend_lines(uint32_t *out, const uint32_t *a, const uint32_t *b, int w, int n)
+{
+    int i = 0, c;
+    uint32_t p, q, v;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(256 - w), wb = _mm_set1_epi16(w);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i pa = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i pb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(pa, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(pb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(pa, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(pb, zero), wb));
+        _mm_storeu_si128((__m128i *)(out + i),
+                         _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+    for (; i < n; i++) {
+        p = a[i];
+        q = b[i];
+        v = 0;
+        for (c = 0; c < 32; c += 8)
+            v |= ((((p >> c) & 0xff) * (256 - w) + ((q >> c) & 0xff) * w) >> 8) << c;
+        out[i] = v;
+    }
+}
+
+/* Destination columns x0 to x1 of one line, from the line blended for it,
+ * which starts at source column base.
+ */
+static void scale_line(FBScale *scale, uint32_t *out, const uint32_t *line, int base,
+                       int x0, int x1)
+{
+    const int *index = scale->x_index;
+    const int16_t *weights = scale->x_weights;
+    const uint32_t *t;
+    int x;
+
+    if (scale->filter == FBSCALE_NEAREST) {
+        for (x = x0; x < x1; x++)
+            *out++ = line[index[x] - base];
+        return;
+    }
+    for (x = x0; x < x1; x++) {
+        t = line + index[x] - base;
+#ifdef __SSE2__
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)t),
+                                      _mm_setzero_si128());
+        p = _mm_mullo_epi16(p, _mm_loadu_si128((const __m128i *)(weights + x * 8)));
+        p = _mm_srli_epi16(_mm_add_epi16(p, _mm_srli_si128(p, 8)), 8);
+        *out++ = _mm_cvtsi128_si32(_mm_packus_epi16(p, p));
+#else
+        int c, w = weights[x * 8 + 4];
+        uint32_t v = 0;
+        for (c = 0; c < 32; c += 8)
+            v |= ((((t[0] >> c) & 0xff) * (256 - w) + ((t[1] >> c) & 0xff) * w) >> 8) << c;
+        *out++ = v;
+#endif
+    }
+}
+
+/* Draw the destination rect (x, y, w, h), relative to the scale rect.  On a
+ * rotated surface up to FBBLIT_TILE lines are scaled into out and then
+ * rotated together.
+ */
+static void scale_rect(FBSurface *dst, FBSource *src, FBScale *scale, int x, int y,
+                       int w, int h, uint32_t *line, uint32_t *out)
+{
+    const uint32_t *a, *b;
+    unsigned char *d;
+    uint32_t *o = out;
+    int row, sy, c0, c1, first = y;
+    FBSource block;
+
+    if (w <= 0 || h <= 0)
+        return;
+    // the source columns needed are c0 to c1
+    c0 = scale->x_index[x];
+    c1 = scale->x_index[x + w - 1] + 1;
+    d = dst->mem + (scale->dst_y + y) * dst->line_length +
+        (scale->dst_x + x) * dst->bytes_per_pixel;
+
+    for (row = y; row < y + h; row++, d += dst->line_length) {
+        sy = scale->y_index[row];
+        a = src->pixels + sy * src->stride;
+        if (scale->filter == FBSCALE_NEAREST)
+            scale_line(scale, o, a, 0, x, x + w);
+        else {
+            b = sy + 1 < src->height ? a + src->stride : a;
+            if (c1 < src->width)
+                blend_lines(line, a + c0, b + c0, scale->y_weights[row], c1 - c0 + 1);
+            else {
+                // The last column has weight 0 for its right neighbour.
+                blend_lines(line, a + c0, b + c0, scale->y_weights[row], c1 - c0);
+                line[c1 - c0] = line[c1 - c0 - 1];
+            }
+            scale_line(scale, o, line, c0, x, x + w);
+        }
+
+        if (dst->rotation == FBBLIT_ROTATE_0)
+            dst->convert_row(d, out, w, dst, scale->dst_x + x, scale->dst_y + row);
+        else if (row - first == FBBLIT_TILE - 1 || row == y + h - 1) {
+            block.pixels = out;
+            block.width = block.stride = w;
+            block.height = row - first + 1;
+            fbblit_rect(dst, &block, 0, 0, w, block.height, scale->dst_x + x,
+                        scale->dst_y + first);
+            first = row + 1;
+            o = out;
+        } else
+            o += w;
+    }
+}
+
+typedef struct {
+    FBSurface *dst;
+    FBSource *src;
+    FBScale *scale;
+    const int *rects;
+    int n_rects;
+    int y0, y1;             // lines covered by the rects
+} FBScaleJob;
+
+static void scale_band(void *data, int band, int n_bands)
+{
+    FBScaleJob *job = data;
+    const int *r;
+    uint32_t *line, *out;
+    int i, y0, y1, top, bottom;
+
+    top = job->y0 + (job->y1 - job->y0) * band / n_bands;
+    bottom = job->y0 + (job->y1 - job->y0) * (band + 1) / n_bands;
+    line = malloc(sizeof(uint32_t) * (job->src->width + 1));
+    out = malloc(sizeof(uint32_t) * job->scale->dst_w *
+                 (job->dst->rotation == FBBLIT_ROTATE_0 ? 1 : FBBLIT_TILE));
+    if (line && out) {
+        for (i = 0; i < job->n_rects; i++) {
+            r = job->rects + i * 4;
+            y0 = r[1] > top ? r[1] : top;
+            y1 = r[1] + r[3] < bottom ? r[1] + r[3] : bottom;
+            if (y1 > y0)
+                scale_rect(job->dst, job->src, job->scale, r[0], y0, r[2], y1 - y0,
+                           line, out);
+        }
+    }
+    free(line);
+    free(out);
+}
+
+/* Scale the given rects (x, y, w, h) of the source, or all of it if n_rects
+ * is -1, into the rect set up with fbscale_setup.
+ */
+void fbscale_rects(FBSurface *dst, FBSource *src, FBScale *scale, const int *rects,
+                   int n_rects, FBBlitPool *pool)
+{
+    FBScaleJob job;
+    int *mapped, i, x0, y0, x1, y1, dw = scale->dst_w, dh = scale->dst_h;
+    int surface_w = FBSURFACE_WIDTH(dst), surface_h = FBSURFACE_HEIGHT(dst);
+    long long sw = scale->src_w, sh = scale->src_h;
+
+    if (n_rects < 0)
+        n_rects = 1;
+    job.y0 = INT_MAX;
+    job.y1 = INT_MIN;
+    mapped = malloc(sizeof(int) * 4 * n_rects);
+    if (!mapped)
+        return;
+
+    for (i = 0; i < n_rects; i++) {
+        if (!rects) {
+            x0 = y0 = 0;
+            x1 = dw;
+            y1 = dh;
+        } else {
+            // Destination pixels whose filter reaches into the rect
+            x0 = (int)((rects[i * 4] - 1) * dw / sw) - 1;
+            y0 = (int)((rects[i * 4 + 1] - 1) * dh / sh) - 1;
+            x1 = (int)((rects[i * 4] + rects[i * 4 + 2] + 1) * dw / sw) + 2;
+            y1 = (int)((rects[i * 4 + 1] + rects[i * 4 + 3] + 1) * dh / sh) + 2;
+        }
+        // Clip to the scale rect and the surface.
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        if (x0 < -scale->dst_x) x0 = -scale->dst_x;
+        if (y0 < -scale->dst_y) y0 = -scale->dst_y;
+        if (x1 > dw) x1 = dw;
+        if (y1 > dh) y1 = dh;
+        if (x1 > surface_w - scale->dst_x) x1 = surface_w - scale->dst_x;
+        if (y1 > surface_h - scale->dst_y) y1 = surface_h - scale->dst_y;
+        mapped[i * 4] = x0;
+        mapped[i * 4 + 1] = y0;
+        mapped[i * 4 + 2] = x1 - x0;
+        mapped[i * 4 + 3] = y1 - y0;
+        if (x1 > x0 && y1 > y0) {
+            if (y0 < job.y0)
+                job.y0 = y0;
+            if (y1 > job.y1)
+                job.y1 = y1;
+        }
+    }
+
+    job.dst = dst;
+    job.src = src;
+    job.scale = scale;
+    job.rects = mapped;
+    job.n_rects = n_rects;
+    if (job.y1 > job.y0) {
+        if (fbblit_rects_area(mapped, n_rects) < FBBLIT_THREAD_MIN)
+            pool = NULL;
+        fbblit_pool_run(pool, scale_band, &job);
+    }
+    free(mapped);
+}
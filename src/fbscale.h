@@ -0,0 +1,61 @@
+/*
+ * ----------------------------------------------------------------------------
+ * fbscale.h - Framebuffer scaling
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Dirk Meyer <dmeyer@tzi.de>
+ * Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _FBSCALE_H_
+#define _FBSCALE_H_
+
+#include <stdint.h>
+#include "fbblit.h"
+
+enum {
+    FBSCALE_NONE,
+    FBSCALE_NEAREST,
+    FBSCALE_BILINEAR
+};
+
+// Tables for scaling one source size into a destination rect.
+typedef struct {
+    int filter;
+    int src_w, src_h;
+    int dst_x, dst_y, dst_w, dst_h;
+    int *x_index, *y_index;     // source column/line for each destination one
+    int16_t *x_weights;         // bilinear: 4 x (256 - w), 4 x w per column
+    int *y_weights;             // bilinear: weight of the next line
+} FBScale;
+
+int fbscale_setup(FBScale *scale, int filter, int src_w, int src_h,
+                  int dst_x, int dst_y, int dst_w, int dst_h);
+void fbscale_free(FBScale *scale);
+void fbscale_rects(FBSurface *dst, FBSource *src, FBScale *scale, const int *rects,
+                   int n_rects, FBBlitPool *pool);
+
+#endif
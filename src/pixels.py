@@ -0,0 +1,68 @@
+# -*- coding: iso-8859-1 -*-
+# -----------------------------------------------------------------------------
+# pixels.py - Pixel buffers as image sources
+# -----------------------------------------------------------------------------
+# $Id$
+#
+# -----------------------------------------------------------------------------
+# kaa.display - Generic Display Module
+# Copyright (C) 2006-2008 Dirk Meyer, Jason Tackaberry
+#
+# First Edition: Dirk Meyer <dmeyer@tzi.de>
+# Maintainer:    Dirk Meyer <dmeyer@tzi.de>
+#
+# Please see the file AUTHORS for a complete list of authors.
+#
+# This library is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License version
+# 2.1 as published by the Free Software Foundation.
+#
+# This library is distributed in the hope that it will be useful, but
+# WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public
+# License along with this library; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+# 02110-1301 USA
+#
+# -----------------------------------------------------------------------------
+
+
+__all__ = [ 'PixelBuffer' ]
+
+
+class PixelBuffer(object):
+    """
+    Pixels in memory of another object, usable wherever an imlib2 image is
+    drawn: Framebuffer.set_image(), PygameDisplay.render_imlib2_image() and
+    X11Window.render_imlib2_image().  The memory is read in place and held
+    while it is drawn, so resizing e.g. a bytearray meanwhile fails.
+
+    Objects with only the old buffer protocol, like mmap (e.g. shared memory
+    of another process) and array in Python 2, are read in place as well
+    but can't be held; they must not be resized or closed while drawing.
+    Framebuffer.blend() needs an imlib2 image and does not work with a
+    PixelBuffer.
+
+    @param buffer: object supporting the buffer protocol, e.g. a str,
+                   bytearray, mmap or numpy array
+    @param size: (width, height) in pixels
+    @param stride: bytes from one line to the next, width * 4 if not given;
+                   for X11 windows the buffer must cover stride * height
+    @param format: 'BGRA' (the imlib2 layout) or 'BGRX' to ignore alpha;
+                   pixels are 32 bit words in native byte order.  The X byte
+                   is passed on as it is where nothing is converted, e.g. by
+                   Framebuffer.capture() and to 32 bit framebuffers.
+    """
+    def __init__(self, buffer, size, stride=None, format='BGRA'):
+        self.buffer = buffer
+        self.width, self.height = size
+        self.stride = stride or self.width * 4
+        self.format = format
+        self._image = (buffer, self.width, self.height, self.stride, format)
+
+    @property
+    def size(self):
+        return self.width, self.height
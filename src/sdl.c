@@ -35,45 +35,310 @@
 #include "config.h"
 #include <Python.h>
 #include "common.h"
+#include "fbblit.h"
 
 #define X_DISPLAY_MISSING
 #include <Imlib2.h>
 Imlib_Image *(*imlib_image_from_pyobject)(PyObject *pyimg);
 PyTypeObject *Image_PyObject_Type = NULL;
 
+/* Parse a list of ((x, y), (w, h)) areas into a new array of (x, y, w, h).
+ * Returns the number of areas or -1 on errors.
+ */
+static int parse_areas(PyObject *pyareas, int **areas)
+{
+    PyObject *seq;
+    int n, i, *r;
+
+    seq = PySequence_Fast(pyareas, "areas must be a sequence");
+    if (!seq)
+        return -1;
+    n = PySequence_Fast_GET_SIZE(seq);
+    r = *areas = malloc(sizeof(int) * 4 * (n ? n : 1));
+    if (!r) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "(ii)(ii)", &r[i * 4],
+                              &r[i * 4 + 1], &r[i * 4 + 2], &r[i * 4 + 3])) {
+            free(r);
+            Py_DECREF(seq);
+            return -1;
+        }
+    }
+    Py_DECREF(seq);
+    return n;
+}
+
+
+/* Describe the pixel format of an SDL surface for fbblit, which has the
+ * conversions from ARGB32 into 15, 16, 24 and 32 bit layouts.  Returns 0
+ * for formats it can't convert into, like 8 bit palettes.
+ */
+static int surface_format(SDL_Surface *surf, FBSurface *dst)
+{
+    SDL_PixelFormat *format = surf->format;
+
+    memset(dst, 0, sizeof(*dst));
+    dst->width = surf->w;
+    dst->height = surf->h;
+    dst->line_length = surf->pitch;
+    dst->bytes_per_pixel = format->BytesPerPixel;
+    dst->red.offset = format->Rshift;
+    dst->red.length = format->Rmask ? 8 - format->Rloss : 0;
+    dst->green.offset = format->Gshift;
+    dst->green.length = format->Gmask ? 8 - format->Gloss : 0;
+    dst->blue.offset = format->Bshift;
+    dst->blue.length = format->Bmask ? 8 - format->Bloss : 0;
+    dst->transp.offset = format->Ashift;
+    dst->transp.length = format->Amask ? 8 - format->Aloss : 0;
+    return !format->palette && fbblit_setup(dst);
+}
+
+
+/* Copy an imlib2 image into a pygame surface, converting it to the pixel
+ * format of the surface, or only the given list of ((x, y), (w, h)) areas
+ * of it.  Instead of an image, a (buffer, width, height, stride, format)
+ * tuple can be given (see pixel_buffer_from_pyobject); it is read in place.
+ * The image is clipped to the surface.  The surface is locked meanwhile.
+ */
 PyObject *image_to_surface(PyObject *self, PyObject *args)
 {
-    PyObject *pyimg;
-    Imlib_Image *img;
+    PyObject *pyimg, *pyareas = Py_None;
     PySurfaceObject *pysurf;
-    unsigned char *pixels;
+    PixelBuffer buf;
+    FBSurface dst;
+    FBSource src;
+    int *areas = NULL, n_areas = -1;
 
-    static int init = 0;
+    if (!PyArg_ParseTuple(args, "OO!|O", &pyimg, &PySurface_Type, &pysurf, &pyareas))
+        return NULL;
 
-    CHECK_IMAGE_PYOBJECT
+    if (!surface_format(pysurf->surf, &dst)) {
+        PyErr_Format(PyExc_ValueError, "unsupported surface format (%d bit)",
+                     pysurf->surf->format->BitsPerPixel);
+        return NULL;
+    }
 
-    if (init == 0) {
-        import_pygame_surface();
-        init = 1;
+    buf.view.obj = NULL;
+    if (PyTuple_Check(pyimg)) {
+        if (!pixel_buffer_from_pyobject(pyimg, &buf))
+            return NULL;
+        src.pixels = buf.pixels;
+        src.width = buf.width;
+        src.height = buf.height;
+        src.stride = buf.stride;
+    } else {
+        CHECK_IMAGE_PYOBJECT
+        if (!PyObject_TypeCheck(pyimg, Image_PyObject_Type)) {
+            PyErr_Format(PyExc_TypeError, "imlib2 image or pixel buffer needed");
+            return NULL;
+        }
+        imlib_context_set_image(imlib_image_from_pyobject(pyimg));
+        src.pixels = imlib_image_get_data_for_reading_only();
+        src.width = src.stride = imlib_image_get_width();
+        src.height = imlib_image_get_height();
     }
 
-    if (!PyArg_ParseTuple(args, "O!O!", Image_PyObject_Type, &pyimg,
-                          &PySurface_Type, &pysurf))
+    if (pyareas != Py_None && (n_areas = parse_areas(pyareas, &areas)) < 0) {
+        pixel_buffer_release(&buf);
+        return NULL;
+    }
+
+    if (!PySurface_Lock((PyObject *)pysurf)) {
+        free(areas);
+        pixel_buffer_release(&buf);
+        return NULL;
+    }
+    dst.mem = pysurf->surf->pixels;
+
+    Py_BEGIN_ALLOW_THREADS
+    fbblit_rects(&dst, &src, areas, n_areas, 0, 0, NULL);
+    Py_END_ALLOW_THREADS
+
+    free(areas);
+    pixel_buffer_release(&buf);
+    if (!PySurface_Unlock((PyObject *)pysurf))
+        return NULL;
+
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
+
+/* Return a pygame surface using the pixels of an imlib2 image, without
+ * copying them.  The surface keeps a reference to the image.  With writable,
+ * drawing into the surface changes the pixels of the image, but imlib2 has
+ * to be told with image_changed() afterwards so it drops what it derived
+ * from them (e.g. scaled copies).  Otherwise the surface must only be read
+ * from, e.g. blitted to the screen.
+ */
+PyObject *image_surface(PyObject *self, PyObject *args)
+{
+    PyObject *pyimg, *pysurf;
+    Imlib_Image *img;
+    SDL_Surface *surf;
+    DATA32 *pixels;
+    int writable = 0, width, height;
+
+    CHECK_IMAGE_PYOBJECT
+
+    if (!PyArg_ParseTuple(args, "O!|i", Image_PyObject_Type, &pyimg, &writable))
         return NULL;
 
-    img  = imlib_image_from_pyobject(pyimg);
+    img = imlib_image_from_pyobject(pyimg);
     imlib_context_set_image(img);
-    pixels = (unsigned char *)imlib_image_get_data_for_reading_only();
-    memcpy(pysurf->surf->pixels, pixels, imlib_image_get_width() *
-           imlib_image_get_height() * 4);
+    if (writable) {
+        // imlib2 takes the pixels back at once; image_changed() repeats
+        // this after drawing.
+        pixels = imlib_image_get_data();
+        imlib_image_put_back_data(pixels);
+    } else
+        pixels = imlib_image_get_data_for_reading_only();
+    width = imlib_image_get_width();
+    height = imlib_image_get_height();
+
+    surf = SDL_CreateRGBSurfaceFrom(pixels, width, height, 32, width * 4,
+                                    0x00ff0000, 0x0000ff00, 0x000000ff,
+                                    imlib_image_has_alpha() ? 0xff000000 : 0);
+    if (!surf) {
+        PyErr_Format(PyExc_SystemError, "unable to create surface: %s", SDL_GetError());
+        return NULL;
+    }
+    pysurf = PySurface_New(surf);
+    if (!pysurf) {
+        SDL_FreeSurface(surf);
+        return NULL;
+    }
+    // freed with the surface
+    Py_INCREF(pyimg);
+    ((PySurfaceObject *)pysurf)->dependency = pyimg;
+    return pysurf;
+}
+
+
+/* Tell imlib2 that the pixels of an image were changed behind its back,
+ * e.g. through a writable surface from image_surface().
+ */
+PyObject *image_changed(PyObject *self, PyObject *args)
+{
+    PyObject *pyimg;
+
+    CHECK_IMAGE_PYOBJECT
+
+    if (!PyArg_ParseTuple(args, "O!", Image_PyObject_Type, &pyimg))
+        return NULL;
 
+    imlib_context_set_image(imlib_image_from_pyobject(pyimg));
+    imlib_image_put_back_data(imlib_image_get_data());
     Py_INCREF(Py_None);
     return Py_None;
 }
 
 
+// Events taken from the queue at a time
+#define EVENT_BATCH 64
+
+// The mouse cursor is shown when the mouse moved more than this many pixels
+// between two polls, and hidden again after a while.
+#define CURSOR_MIN_MOVE 4
+
+static struct {
+    int visible;
+    Uint32 hide_at;
+} cursor = { 1, 0 };
+
+/* Append (signal, args) to events.  Returns -1 with an exception set if
+ * that or building args failed.
+ */
+static int append_event(PyObject *events, const char *signal, PyObject *args)
+{
+    PyObject *o;
+    int err;
+
+    if (!args)
+        return -1;
+    o = Py_BuildValue("(sN)", signal, args);
+    if (!o)
+        return -1;
+    err = PyList_Append(events, o);
+    Py_DECREF(o);
+    return err;
+}
+
+
+/* Take all events from the SDL queue and return the key presses and mouse
+ * buttons as a list of (signal name, arguments) for PygameDisplay.  Other
+ * events are dropped; mouse motion only counts for the cursor, which is
+ * shown when the mouse moves and hidden hide_delay ms later if hide_mouse
+ * is set.
+ */
+PyObject *poll_events(PyObject *self, PyObject *args)
+{
+    SDL_Event batch[EVENT_BATCH], *ev;
+    PyObject *events;
+    int hide_mouse, hide_delay, n, i, dx = 0, dy = 0, err = 0;
+    Uint32 now;
+
+    if (!PyArg_ParseTuple(args, "ii", &hide_mouse, &hide_delay))
+        return NULL;
+
+    events = PyList_New(0);
+    if (!events)
+        return NULL;
+
+    SDL_PumpEvents();
+    do {
+        n = SDL_PeepEvents(batch, EVENT_BATCH, SDL_GETEVENT, SDL_ALLEVENTS);
+        for (i = 0, ev = batch; i < n && !err; i++, ev++) {
+            switch (ev->type) {
+            case SDL_MOUSEMOTION:
+                dx += ev->motion.xrel;
+                dy += ev->motion.yrel;
+                break;
+            case SDL_KEYDOWN:
+                err = append_event(events, "key_press_event",
+                                   Py_BuildValue("(i)", ev->key.keysym.sym));
+                break;
+            case SDL_MOUSEBUTTONDOWN:
+            case SDL_MOUSEBUTTONUP:
+                err = append_event(events, ev->type == SDL_MOUSEBUTTONDOWN ?
+                                   "mouse_down_event" : "mouse_up_event",
+                                   Py_BuildValue("(i(ii))", ev->button.button,
+                                                 ev->button.x, ev->button.y));
+                break;
+            }
+        }
+    } while (n == EVENT_BATCH && !err);
+
+    if (err) {
+        Py_DECREF(events);
+        return NULL;
+    }
+
+    if (hide_mouse) {
+        now = SDL_GetTicks();
+        if (dx * dx + dy * dy > CURSOR_MIN_MOVE * CURSOR_MIN_MOVE) {
+            if (!cursor.visible)
+                SDL_ShowCursor(SDL_ENABLE);
+            cursor.visible = 1;
+            cursor.hide_at = now + hide_delay;
+        } else if (cursor.visible && (Sint32)(now - cursor.hide_at) > 0) {
+            SDL_ShowCursor(SDL_DISABLE);
+            cursor.visible = 0;
+        }
+    }
+    return events;
+}
+
+
 PyMethodDef sdl_methods[] = {
     { "image_to_surface", (PyCFunction) image_to_surface, METH_VARARGS },
+    { "image_surface", (PyCFunction) image_surface, METH_VARARGS },
+    { "image_changed", (PyCFunction) image_changed, METH_VARARGS },
+    { "poll_events", (PyCFunction) poll_events, METH_VARARGS },
     { NULL }
 };
 
@@ -83,6 +348,7 @@ void init_SDL(void)
     void **imlib2_api_ptrs;
 
     Py_InitModule("_SDL", sdl_methods);
+    import_pygame_surface();
 
     // Import kaa-imlib2's C api
     imlib2_api_ptrs = get_module_api("kaa.imlib2._Imlib2");
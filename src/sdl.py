@@ -31,8 +31,6 @@
 
 # python imports
 import pygame
-import pygame.locals
-import time
 import kaa
 
 # the display module
@@ -46,16 +44,9 @@ class PygameDisplay(object):
             pygame.display.init()
             pygame.font.init()
 
-        # get screen with 32 bit
+        # get screen with 32 bit if possible; images are converted to
+        # other depths when they are copied
         self._screen = pygame.display.set_mode(size, 0, 32)
-        if self._screen.get_bitsize() != 32:
-            # if the bitsize is not 32 as requested, we need
-            # a tmp surface to convert from imlib2 to pygame
-            # because imlib2 uses 32 bit and with a different
-            # value memcpy will do nasty things
-            self._surface = pygame.Surface(size, 0, 32)
-        else:
-            self._surface = None
         # define signals
         self.signals = { 'key_press_event' : kaa.Signal(),
                          'mouse_up_event'  : kaa.Signal(),
@@ -66,28 +57,16 @@ class PygameDisplay(object):
         pygame.key.set_repeat(500, 30)
         # mouse settings
         self.hide_mouse = True
-        self.mousehidetime = time.time()
 
 
     def render_imlib2_image(self, image, areas=None):
         """
-        Render image to pygame surface. The image size must be the same size
-        as the pygame window or it will crash. The optional parameter areas
-        is a list of pos, size of the areas to update.
+        Render image to pygame surface. The image is clipped to the size of
+        the pygame window. The optional parameter areas is a list of pos,
+        size of the areas to update; only those are copied.  Instead of an
+        imlib2 image a PixelBuffer can be given; it is read in place.
         """
-        if self._surface:
-            # we need to use our tmp surface
-            _SDL.image_to_surface(image, self._surface)
-            if areas == None:
-                # copy everything
-                self._screen.blit(self._surface, (0,0))
-            else:
-                # copy only the needed areas
-                for pos, size in areas:
-                    self._screen.blit(self._surface, pos, pos + size)
-        else:
-            # copy everything
-            _SDL.image_to_surface(image, self._screen)
+        _SDL.image_to_surface(getattr(image, '_image', image), self._screen, areas)
 
         # update the screen
         if areas:
@@ -96,38 +75,34 @@ class PygameDisplay(object):
             pygame.display.update()
 
 
-    def poll(self):
+    def get_imlib2_surface(self, image, writable=False):
         """
-        Pygame poll function to get events.
+        Return a pygame surface using the pixels of an imlib2 image without
+        copying them, e.g. to blit it to the screen.  The surface keeps the
+        image alive.  With writable, drawing into the surface changes the
+        image, and imlib2_surface_changed() must be called afterwards so
+        imlib2 drops what it derived from the old pixels.  Otherwise the
+        surface must only be read from.
         """
-        if not pygame.display.get_init():
-            return True
-
-        if self.hide_mouse:
-            # Check if mouse should be visible or hidden
-            mouserel = pygame.mouse.get_rel()
-            mousedist = (mouserel[0]**2 + mouserel[1]**2) ** 0.5
-
-            if mousedist > 4.0:
-                pygame.mouse.set_visible(1)
-                # Hide the mouse in 2s
-                self.mousehidetime = time.time() + 1.0
-            else:
-                if time.time() > self.mousehidetime:
-                    pygame.mouse.set_visible(0)
+        return _SDL.image_surface(getattr(image, '_image', image), writable)
 
-        # Signal the events
-        while 1:
-            event = pygame.event.poll()
 
-            if event.type == pygame.locals.NOEVENT:
-                return True
+    def imlib2_surface_changed(self, image):
+        """
+        Tell imlib2 that image was drawn into through a writable surface
+        from get_imlib2_surface().
+        """
+        _SDL.image_changed(getattr(image, '_image', image))
 
-            if event.type == pygame.locals.KEYDOWN:
-                self.signals["key_press_event"].emit(event.key)
 
-            if event.type == pygame.locals.MOUSEBUTTONDOWN:
-                self.signals["mouse_down_event"].emit(event.button, event.pos)
+    def poll(self):
+        """
+        Pygame poll function to get events.
+        """
+        if not pygame.display.get_init():
+            return True
 
-            if event.type == pygame.locals.MOUSEBUTTONUP:
-                self.signals["mouse_up_event"].emit(event.button, event.pos)
+        # Take all events at once; the cursor is shown and hidden in C.
+        for signal, args in _SDL.poll_events(self.hide_mouse, 1000):
+            self.signals[signal].emit(*args)
+        return True
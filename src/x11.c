@@ -34,6 +34,8 @@
 #include "config.h"
 #include "x11display.h"
 #include "x11window.h"
+#include "x11shape.h"
+#include "colorlut.h"
 #include "common.h"
 
 
@@ -45,33 +47,115 @@ PyTypeObject *Image_PyObject_Type = NULL;
 #endif
 
 
+#if defined(USE_IMLIB2_X11) && !defined(X_DISPLAY_MISSING)
+/* Copy the part (x, y, w, h) of the current image through the colour table
+ * into a new image, which becomes the current one.  Returns the pixel data
+ * to free after the image, or NULL if out of memory.
+ */
+static DATA32 *apply_color_lut(ColorLUT *lut, int x, int y, int w, int h)
+{
+    DATA32 *src, *data;
+    int row, stride = imlib_image_get_width(), has_alpha = imlib_image_has_alpha();
+
+    data = malloc(sizeof(DATA32) * w * h);
+    if (!data)
+        return NULL;
+    src = imlib_image_get_data_for_reading_only() + y * stride + x;
+    for (row = 0; row < h; row++)
+        colorlut_apply(lut, data + row * w, src + row * stride, w);
+
+    imlib_context_set_image(imlib_create_image_using_data(w, h, data));
+    imlib_image_set_has_alpha(has_alpha);
+    return data;
+}
+#endif
+
+
 PyObject *render_imlib2_image(PyObject *self, PyObject *args)
 {
 #if defined(USE_IMLIB2_X11) && !defined(X_DISPLAY_MISSING)
     X11Window_PyObject *window;
     PyObject *pyimg;
-    Imlib_Image *img;
+    PixelBuffer buf;
+    Imlib_Image *img, wrapped = NULL;
     XWindowAttributes attrs;
+    DATA32 *lut_data = NULL;
     int dst_x = 0, dst_y = 0, src_x = 0, src_y = 0,
         w = -1, h = -1, img_w, img_h, dither = 1, blend = 0;
 
-    CHECK_IMAGE_PYOBJECT
-
-    if (!PyArg_ParseTuple(args, "O!O!|(ii)(ii)(ii)ii",
-                &X11Window_PyObject_Type, &window,
-                Image_PyObject_Type, &pyimg,
+    if (!PyArg_ParseTuple(args, "O!O|(ii)(ii)(ii)ii",
+                &X11Window_PyObject_Type, &window, &pyimg,
                 &dst_x, &dst_y, &src_x, &src_y, &w, &h,
                 &dither, &blend))
         return NULL;
 
-    img = imlib_image_from_pyobject(pyimg);
-    imlib_context_set_image(img);
-    img_w = imlib_image_get_width();
-    img_h = imlib_image_get_height();
+    if (PyTuple_Check(pyimg)) {
+        // A (buffer, width, height, stride, format) tuple.  imlib2 has no
+        // stride, so whole lines are wrapped as an image, which must not
+        // end before the padding of the last one, and only the width of
+        // the buffer is drawn; imlib2 does not write to it.
+        if (!pixel_buffer_from_pyobject(pyimg, &buf))
+            return NULL;
+        if (buf.view.len < (Py_ssize_t)buf.stride * 4 * buf.height) {
+            pixel_buffer_release(&buf);
+            PyErr_Format(PyExc_ValueError, "buffer too small for %d lines of %d bytes",
+                         buf.height, buf.stride * 4);
+            return NULL;
+        }
+        wrapped = imlib_create_image_using_data(buf.stride, buf.height,
+                                                (DATA32 *)buf.pixels);
+        if (!wrapped) {
+            pixel_buffer_release(&buf);
+            return PyErr_NoMemory();
+        }
+        imlib_context_set_image(wrapped);
+        imlib_image_set_has_alpha(buf.has_alpha);
+        img_w = buf.width;
+        img_h = buf.height;
+    } else {
+        CHECK_IMAGE_PYOBJECT
+        if (!PyObject_TypeCheck(pyimg, Image_PyObject_Type)) {
+            PyErr_Format(PyExc_TypeError, "imlib2 image or pixel buffer needed");
+            return NULL;
+        }
+        img = imlib_image_from_pyobject(pyimg);
+        imlib_context_set_image(img);
+        img_w = imlib_image_get_width();
+        img_h = imlib_image_get_height();
+    }
 
     if (w == -1) w = img_w;
     if (h == -1) h = img_h;
 
+    if (window->lut || wrapped) {
+        // Only the part drawn is looked up, so clip it to the image.
+        if (src_x < 0) { w += src_x; dst_x -= src_x; src_x = 0; }
+        if (src_y < 0) { h += src_y; dst_y -= src_y; src_y = 0; }
+        if (src_x + w > img_w) w = img_w - src_x;
+        if (src_y + h > img_h) h = img_h - src_y;
+        if (w <= 0 || h <= 0) {
+            if (wrapped) {
+                imlib_free_image_and_decache();
+                pixel_buffer_release(&buf);
+            }
+            Py_INCREF(Py_None);
+            return Py_None;
+        }
+    }
+
+    if (window->lut) {
+        lut_data = apply_color_lut(window->lut, src_x, src_y, w, h);
+        if (!lut_data) {
+            if (wrapped) {
+                imlib_context_set_image(wrapped);
+                imlib_free_image_and_decache();
+                pixel_buffer_release(&buf);
+            }
+            return PyErr_NoMemory();
+        }
+        src_x = src_y = 0;
+    }
+
     XGetWindowAttributes(window->display, window->window, &attrs);
     imlib_context_set_display(window->display);
     imlib_context_set_visual(attrs.visual);
@@ -80,11 +164,22 @@ PyObject *render_imlib2_image(PyObject *self, PyObject *args)
 
     imlib_context_set_dither(dither);
     imlib_context_set_blend(blend);
-    if (src_x == 0 && src_y == 0 && w == img_w && h == img_h)
+    if (src_x == 0 && src_y == 0 && w == imlib_image_get_width() &&
+        h == imlib_image_get_height())
         imlib_render_image_on_drawable(dst_x, dst_y);
     else
         imlib_render_image_part_on_drawable_at_size(src_x, src_y, w, h, dst_x, dst_y, w, h);
 
+    if (lut_data) {
+        imlib_free_image();
+        free(lut_data);
+    }
+    if (wrapped) {
+        imlib_context_set_image(wrapped);
+        imlib_free_image_and_decache();
+        pixel_buffer_release(&buf);
+    }
+
     Py_INCREF(Py_None);
     return Py_None;
 #else
@@ -100,10 +195,9 @@ PyObject *set_shape_mask_from_imlib2_image(PyObject *self, PyObject *args)
     X11Window_PyObject *window;
     PyObject *pyimg;
     Imlib_Image *img;
-    int x = 0, y = 0, threshold;
-    XWindowAttributes attrs;
-    Pixmap image_pixmap, mask_pixmap;
-    
+    int x = 0, y = 0, threshold = 128, width, height, changed;
+    unsigned char *bits;
+
     CHECK_IMAGE_PYOBJECT
 
     if (!PyArg_ParseTuple(args, "O!O!|(ii)i",
@@ -113,25 +207,23 @@ PyObject *set_shape_mask_from_imlib2_image(PyObject *self, PyObject *args)
         return NULL;
 
     img = imlib_image_from_pyobject(pyimg);
-    
-    XGetWindowAttributes(window->display, window->window, &attrs);
-    
-    imlib_context_set_display(window->display);
-    imlib_context_set_drawable(window->window);
-    imlib_context_set_visual(attrs.visual);
-    imlib_context_set_colormap(attrs.colormap);    
-    
     imlib_context_set_image(img);
-    imlib_context_set_mask_alpha_threshold(threshold);
-    
-    imlib_render_pixmaps_for_whole_image(&image_pixmap, &mask_pixmap);
-    if (mask_pixmap != None) {
-        XShapeCombineMask(window->display, window->window, ShapeBounding, x, y, mask_pixmap, ShapeSet);
-        imlib_free_pixmap_and_mask(image_pixmap);
-    }
-    
-    Py_INCREF(Py_None);
-    return Py_None;
+    width = imlib_image_get_width();
+    height = imlib_image_get_height();
+
+    // Threshold the alpha channel directly rather than having imlib2 render
+    // (and upload) a full colour pixmap just to get at its mask.
+    bits = malloc(SHAPE_BYTES_PER_LINE(width) * height);
+    if (!bits)
+        return PyErr_NoMemory();
+    x11shape_pack_alpha((uint32_t *)imlib_image_get_data_for_reading_only(),
+                        width, width, height, threshold, bits);
+
+    XLockDisplay(window->display);
+    changed = x11shape_apply(window, bits, x, y, width, height);
+    XUnlockDisplay(window->display);
+
+    return PyBool_FromLong(changed);
 #else
     PyErr_Format(PyExc_SystemError, "kaa-display compiled without imlib2 display support.");
     return NULL;
@@ -133,6 +133,7 @@ class X11Display(kaa.Object):
         super(X11Display, self).__init__()
         self._display = _X11.X11Display(dispname, X11Error, kaa.WeakCallable(self._handle_error))
         self._windows = {}
+        self._window_pools = {}
 
         dispatcher = kaa.WeakIOMonitor(self.handle_events)
         dispatcher.register(self.socket)
@@ -218,6 +219,67 @@ class X11Display(kaa.Object):
     def composite_supported(self):
         return self._display.composite_supported()
 
+    def get_extensions(self):
+        """
+        Return a dict mapping the names of the supported X extensions among
+        Composite, RENDER, MIT-SHM, SHAPE, Present and DAMAGE to their
+        (major, minor) version.  The server is only queried once per display.
+        Versions of Present and DAMAGE are not probed and given as (0, 0).
+        """
+        return self._display.get_extensions()
+
+    def fill_window_pool(self, count, argb=False, override_redirect=False, input_only=False):
+        """
+        Create windows ahead of time so get_pooled_window() can hand them out
+        without waiting for the X server.  Windows are kept unmapped until
+        needed.
+
+        @param count: number of windows of this kind to keep in the pool.
+        @param argb: create windows with a 32-bit ARGB visual.
+        @param override_redirect: create windows the window manager ignores,
+                                  as usual for popups.
+        @param input_only: create input-only windows.
+        """
+        key = bool(argb), bool(override_redirect), bool(input_only)
+        pool = self._window_pools.setdefault(key, [])
+        while len(pool) < count:
+            pool.append(self._new_pooled_window(key))
+
+    def _new_pooled_window(self, key):
+        argb, override_redirect, input_only = key
+        window = X11Window(display=self, size=(1, 1), argb=argb,
+                           override_redirect=override_redirect, input_only=input_only)
+        window._pool_key = key
+        return window
+
+    def get_pooled_window(self, pos, size, raised=True, argb=False,
+                          override_redirect=False, input_only=False):
+        """
+        Take a window from the pool (see fill_window_pool()), move it to the
+        given position and size and map it.  If the pool is empty a new
+        window is created.  Give it back with release_window().
+        """
+        key = bool(argb), bool(override_redirect), bool(input_only)
+        pool = self._window_pools.get(key)
+        if pool:
+            window = pool.pop()
+        else:
+            window = self._new_pooled_window(key)
+        w, h = size
+        window._window.configure_and_map(pos, (w or 1, h or 1), raised)
+        return window
+
+    def release_window(self, window):
+        """
+        Unmap a window obtained from get_pooled_window() and return it to the
+        pool.  It leaves fullscreen mode, and its shape mask, cursor, title,
+        transient-for hint, decorations and signal connections are reset.
+        """
+        if getattr(window, '_pool_key', None) is None:
+            raise ValueError('window was not obtained from get_pooled_window()')
+        window._reset()
+        self._window_pools.setdefault(window._pool_key, []).append(window)
+
     def get_root_window(self):
         return X11Window(window = self._display.get_root_id())
 
@@ -275,6 +337,8 @@ class X11Window(object):
            composite: A boolean to indicate whether the window can make use of 
                       the XComposite extension to display translucent areas by 
                       drawing to the window using an image with an alpha channel.
+           override_redirect: A boolean, default False, to create a window
+                              that is not managed by the window manager.
         
         The following kwargs apply in either case:
            window_events: A boolean, default True, to indicate whether the 
@@ -337,6 +401,21 @@ class X11Window(object):
     def __str__(self):
         return '<X11Window object id=0x%x>' % self._window.wid
 
+    def _reset(self):
+        """
+        Unmap the window and clear per-use state so it can be reused from a
+        window pool.
+        """
+        if self._fs_size_save:
+            self.set_fullscreen(False)
+        self._window.reset()
+        self._cursor_hide_timer.stop()
+        self._cursor_visible = True
+        self._fs_size_save = None
+        self._last_configured_size = 0, 0
+        for signal in self.signals.values():
+            signal.disconnect_all()
+
     def get_display(self):
         return self._display
 
@@ -375,7 +454,7 @@ class X11Window(object):
 
     def render_imlib2_image(self, i, dst_pos = (0, 0), src_pos = (0, 0),
                             size = (-1, -1), dither = True, blend = False):
-        return _X11.render_imlib2_image(self._window, i._image, dst_pos, \
+        return _X11.render_imlib2_image(self._window, getattr(i, '_image', i), dst_pos, \
                                             src_pos, size, dither, blend)
 
     def handle_events(self, events):
@@ -620,23 +699,23 @@ class X11Window(object):
 
         return props
 
-    def set_shape_mask(self, mask, pos, size ):
+    def set_shape_mask(self, mask, pos, size, incremental=False):
         """
         Set the shape mask for a window using the XShape extension.
         
-        @param mask: A string containing either a bitmask or a byte-per-pixel 
-                     to use as the shape mask.
+        @param mask: Any object supporting the buffer protocol (string,
+                     bytearray, numpy array, ...) holding either a byte per
+                     pixel (non-zero is visible) or a bitmask with each row
+                     padded to a whole byte, least significant bit first.
         @param pos: X,Y Position in the window to apply the mask.
         @param size: Width,Height of the mask.
+        @param incremental: If True and the last mask applied had the same
+                            position and size, only the rows that changed
+                            are sent to the X server.
+        @return: True if the shape was changed, False if the mask is identical
+                 to the one last applied.
         """
-        
-        if len(mask) == ((size[0] * size[1]) + 7) / 8 or len(mask) == size[0] * size[1]:
-            # Add 7 ensures that when we divided by 8 we have enough bytes to store 
-            # all the bits needed. Take 3w * 3h = 9 bits, (3 * 3) + 7 = 16 bits 
-            # ie 2 bytes.
-            self._window.set_shape_mask(mask, pos, size)
-        else:
-            raise ValueError('Mask is wrong length!')
+        return self._window.set_shape_mask(mask, pos, size, incremental)
     
     def set_shape_mask_from_imlib2_image(self, image, pos=(0,0), threshold=128):
         """
@@ -645,9 +724,11 @@ class X11Window(object):
         @param image: Imlib2 image with per pixel alpha to use as the mask.
         @param pos: X,Y Position in the window to apply the mask.
         @param threshold: Pixels with alpha values >= to this will be shown.
+        @return: True if the shape was changed, False if the mask is identical
+                 to the one last applied (in which case nothing is sent).
         """
         if image.has_alpha:
-           _X11.set_shape_mask_from_imlib2_image(self._window, image._image, pos, threshold)
+           return _X11.set_shape_mask_from_imlib2_image(self._window, image._image, pos, threshold)
         else:
             raise ValueError('Image does not have an alpha channel!')
         
@@ -657,6 +738,17 @@ class X11Window(object):
         """
         self._window.reset_shape_mask()
     
+    def set_color_lut(self, lut):
+        """
+        Look up every pixel of images drawn with render_imlib2_image() in the
+        given tables, e.g. for gamma or colour range correction.
+
+        @param lut: (red, green, blue) tables, each a 256 byte string or a
+                    list of 256 ints (see kaa.display.color_lut()), or None
+                    to turn the lookup off.
+        """
+        self._window.set_color_lut(lut)
+
     def set_decorated(self, setting):
         """
         Set whether the window manager should add a border and controls to the
@@ -668,7 +760,24 @@ class X11Window(object):
         """
         self._window.set_decorated(setting)
 
-    def draw_rectangle(self, pos, size, color):
+    def _parse_color(self, color):
         if isinstance(color, basestring) and color[0] == '#' and len(color) == 7:
             color = int(color[1:3], 16), int(color[3:5], 16), int(color[5:], 16)
-        self._window.draw_rectangle(pos, size, color)
+        return color
+
+    def draw_rectangle(self, pos, size, color):
+        self._window.draw_rectangle(pos, size, self._parse_color(color))
+
+    def fill_rectangles(self, rects):
+        """
+        Fill many rectangles at once.
+
+        @param rects: A list of (pos, size, color) tuples, where color is an
+                      (r, g, b) tuple or a '#rrggbb' string.
+
+        Rectangles are grouped by colour and each colour is sent as a single
+        request, so overlapping rectangles of different colours are not
+        guaranteed to be drawn in list order.
+        """
+        self._window.fill_rectangles([ (pos, size, self._parse_color(color))
+                                       for pos, size, color in rects ])
@@ -38,8 +38,11 @@
 #ifdef ENABLE_ENGINE_GL_X11
 #include <GL/glx.h>
 #endif
+#include <X11/extensions/shape.h>
+#include <X11/extensions/XShm.h>
 #ifdef HAVE_X11_COMPOSITE
 #include <X11/extensions/Xcomposite.h>
+#include <X11/extensions/Xrender.h>
 #endif
 
 #include "x11display.h"
@@ -136,6 +139,239 @@ int x_error_trap_pop(int do_raise)
     return result;
 }
 
+static void
+_mask_to_shift(unsigned long mask, int *shift, int *bits)
+{
+    for (*shift = 0; mask && !(mask & 1); mask >>= 1)
+        (*shift)++;
+    for (*bits = 0; mask & 1; mask >>= 1)
+        (*bits)++;
+}
+
+static void
+_visual_format_free(X11VisualFormat *format)
+{
+    X11VisualFormat *next;
+
+    for (; format; format = next) {
+        next = format->next;
+        if (format->pixels)
+            g_hash_table_destroy(format->pixels);
+        g_free(format);
+    }
+}
+
+/* Return the colour layout for the given visual, computing it the first time
+ * the visual is seen on this display.  For visuals without colour masks the
+ * colormap is part of the key, since colours are allocated in it.
+ */
+X11VisualFormat *
+x11display_get_visual_format(X11Display_PyObject *self, Visual *visual,
+                             int depth, Colormap colormap)
+{
+    X11VisualFormat *format, *first;
+
+    first = (X11VisualFormat *)g_hash_table_lookup(self->visual_formats, visual);
+    for (format = first; format; format = format->next)
+        if (format->direct || format->colormap == colormap)
+            return format;
+
+    format = g_new0(X11VisualFormat, 1);
+    format->visual = visual;
+    format->colormap = colormap;
+    format->depth = depth;
+    format->direct = visual->class == TrueColor || visual->class == DirectColor;
+    if (format->direct) {
+        _mask_to_shift(visual->red_mask, &format->red_shift, &format->red_bits);
+        _mask_to_shift(visual->green_mask, &format->green_shift, &format->green_bits);
+        _mask_to_shift(visual->blue_mask, &format->blue_shift, &format->blue_bits);
+        // ARGB visuals: whatever bits are not colour are alpha, and must be
+        // set or the pixel would be transparent.
+        if (depth == 32)
+            format->alpha_mask = 0xffffffffUL & ~(visual->red_mask | visual->green_mask |
+                                                  visual->blue_mask);
+    } else
+        format->pixels = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    if (first) {
+        format->next = first->next;
+        first->next = format;
+    } else
+        g_hash_table_insert(self->visual_formats, visual, format);
+    return format;
+}
+
+static unsigned long
+_scale_component(int c, int shift, int bits)
+{
+    if (bits <= 8)
+        return (unsigned long)(c >> (8 - bits)) << shift;
+    return (unsigned long)(c << (bits - 8)) << shift;
+}
+
+/* Convert an 8-bit per channel RGB colour to a pixel value for the given
+ * visual.  The display must be locked by the caller.
+ */
+unsigned long
+x11display_color_to_pixel(X11Display_PyObject *self, X11VisualFormat *format,
+                          int r, int g, int b)
+{
+    unsigned int rgb = ((r & 0xff) << 16) | ((g & 0xff) << 8) | (b & 0xff);
+    gpointer pixel;
+    XColor color;
+
+    if (format->direct)
+        return _scale_component(rgb >> 16, format->red_shift, format->red_bits) |
+               _scale_component((rgb >> 8) & 0xff, format->green_shift, format->green_bits) |
+               _scale_component(rgb & 0xff, format->blue_shift, format->blue_bits) |
+               format->alpha_mask;
+
+    if (g_hash_table_lookup_extended(format->pixels, GUINT_TO_POINTER(rgb), NULL, &pixel))
+        return (unsigned long)pixel;
+
+    color.red = (rgb >> 16) * 0x101;
+    color.green = ((rgb >> 8) & 0xff) * 0x101;
+    color.blue = (rgb & 0xff) * 0x101;
+    color.flags = DoRed | DoGreen | DoBlue;
+    if (!XAllocColor(self->display, format->colormap, &color))
+        color.pixel = BlackPixel(self->display, DefaultScreen(self->display));
+    g_hash_table_insert(format->pixels, GUINT_TO_POINTER(rgb), (gpointer)color.pixel);
+    return color.pixel;
+}
+
+static const char *x11_extension_names[X11_EXT_COUNT] = {
+    "Composite", "RENDER", "MIT-SHM", "SHAPE", "Present", "DAMAGE"
+};
+
+static void
+_probe_extensions(X11Display_PyObject *self)
+{
+    int i, opcode, event_base, error_base;
+    X11Extension *ext;
+    Bool shared_pixmaps;
+
+    for (i = 0; i < X11_EXT_COUNT; i++)
+        self->extensions[i].present = XQueryExtension(self->display, x11_extension_names[i],
+                                                      &opcode, &event_base, &error_base);
+
+    // Versions for the extensions we have client libraries for.  Present
+    // and Damage are only reported as available.
+#ifdef HAVE_X11_COMPOSITE
+    ext = &self->extensions[X11_EXT_COMPOSITE];
+    if (ext->present) {
+        // The protocol will never report a version higher than the one we
+        // request; 0.2 is the highest we know about.
+        ext->major = 0;
+        ext->minor = 2;
+        XCompositeQueryVersion(self->display, &ext->major, &ext->minor);
+    }
+    ext = &self->extensions[X11_EXT_RENDER];
+    if (ext->present)
+        XRenderQueryVersion(self->display, &ext->major, &ext->minor);
+#endif
+    ext = &self->extensions[X11_EXT_SHM];
+    if (ext->present)
+        XShmQueryVersion(self->display, &ext->major, &ext->minor, &shared_pixmaps);
+    ext = &self->extensions[X11_EXT_SHAPE];
+    if (ext->present)
+        XShapeQueryVersion(self->display, &ext->major, &ext->minor);
+
+    self->probed = 1;
+}
+
+/* Return what the server supports of the given extension.  The server is
+ * only asked the first time; the display must be locked by the caller.
+ */
+X11Extension *
+x11display_get_extension(X11Display_PyObject *self, int ext)
+{
+    if (!self->probed)
+        _probe_extensions(self);
+    return &self->extensions[ext];
+}
+
+#ifdef HAVE_X11_COMPOSITE
+static Visual *
+_find_argb_visual(Display *dpy, int scr)
+{
+    XVisualInfo		*xvi;
+    XVisualInfo		template;
+    int			nvi;
+    int			i;
+    XRenderPictFormat	*format;
+    Visual		*visual;
+
+    template.screen = scr;
+    template.depth = 32;
+    template.class = TrueColor;
+    xvi = XGetVisualInfo (dpy, 
+			  VisualScreenMask |
+			  VisualDepthMask |
+			  VisualClassMask,
+			  &template,
+			  &nvi);
+    if (!xvi)
+        return 0;
+    
+    visual = 0;
+    for (i = 0; i < nvi; i++)
+    {
+        format = XRenderFindVisualFormat (dpy, xvi[i].visual);
+        if (format->type == PictTypeDirect && format->direct.alphaMask)
+        {
+            visual = xvi[i].visual;
+            break;
+        }
+    }
+
+    XFree (xvi);
+    return visual;
+}
+#endif
+
+/* Return the 32-bit ARGB visual of the default screen and a colormap for it,
+ * which all ARGB windows on the display share.  Returns NULL if the server
+ * has none.  The display must be locked by the caller.
+ */
+Visual *
+x11display_get_argb_visual(X11Display_PyObject *self, Colormap *colormap)
+{
+#ifdef HAVE_X11_COMPOSITE
+    if (!self->argb_probed) {
+        int screen = DefaultScreen(self->display);
+        self->argb_visual = _find_argb_visual(self->display, screen);
+        if (self->argb_visual)
+            self->argb_colormap = XCreateColormap(self->display, RootWindow(self->display, screen),
+                                                  self->argb_visual, AllocNone);
+        self->argb_probed = 1;
+    }
+#endif
+    if (colormap)
+        *colormap = self->argb_colormap;
+    return self->argb_visual;
+}
+
+/* Return a blank cursor used to hide the mouse pointer.  One cursor is
+ * shared by all windows of the display.  The display must be locked by the
+ * caller.
+ */
+Cursor
+x11display_get_invisible_cursor(X11Display_PyObject *self)
+{
+    Pixmap pix;
+    static char bits[] = {0, 0, 0, 0, 0, 0, 0};
+    XColor cfg;
+
+    if (!self->invisible_cursor) {
+        cfg.red = cfg.green = cfg.blue = 0;
+        pix = XCreateBitmapFromData(self->display, DefaultRootWindow(self->display), bits, 1, 1);
+        // Memory leak in Xlib: https://bugs.freedesktop.org/show_bug.cgi?id=3568
+        self->invisible_cursor = XCreatePixmapCursor(self->display, pix, pix, &cfg, &cfg, 0, 0);
+        XFreePixmap(self->display, pix);
+    }
+    return self->invisible_cursor;
+}
+
 PyObject *
 X11Display_PyObject__new(PyTypeObject *type, PyObject * args,
                          PyObject * kwargs)
@@ -164,6 +400,9 @@ X11Display_PyObject__new(PyTypeObject *type, PyObject * args,
     self->error_callback = error_callback;
     Py_INCREF(self->x11_error_class);
     Py_INCREF(self->error_callback);
+    self->glx = -1;
+    self->visual_formats = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+                                                 (GDestroyNotify)_visual_format_free);
 
     if (!x11display_pyobjects)
         x11display_pyobjects = g_hash_table_new(g_direct_hash, g_direct_equal);
@@ -184,11 +423,17 @@ void
 X11Display_PyObject__dealloc(X11Display_PyObject * self)
 {
     if (self->display) {
+        if (self->invisible_cursor)
+            XFreeCursor(self->display, self->invisible_cursor);
+        if (self->argb_colormap)
+            XFreeColormap(self->display, self->argb_colormap);
         XCloseDisplay(self->display);
     }
     Py_XDECREF(self->socket);
     Py_XDECREF(self->error_callback);
     Py_XDECREF(self->x11_error_class);
+    if (self->visual_formats)
+        g_hash_table_destroy(self->visual_formats);
     XSetErrorHandler(self->old_handler);
     g_hash_table_remove(x11display_pyobjects, self);
     self->ob_type->tp_free((PyObject*)self);
@@ -373,40 +618,55 @@ X11Display_PyObject__get_string(X11Display_PyObject * self, PyObject * args)
 PyObject *
 X11Display_PyObject__glx_supported(X11Display_PyObject * self, PyObject * args)
 {
+    if (self->glx == -1) {
+        self->glx = 0;
 #ifdef ENABLE_ENGINE_GL_X11
-    static int attribs[] = { GLX_RGBA, None };
-    if (glXChooseVisual(self->display, XDefaultScreen(self->display), attribs)) {
-        Py_INCREF(Py_True);
-        return Py_True;
-    }
+        static int attribs[] = { GLX_RGBA, None };
+        XVisualInfo *vi;
+        XLockDisplay(self->display);
+        vi = glXChooseVisual(self->display, XDefaultScreen(self->display), attribs);
+        XUnlockDisplay(self->display);
+        if (vi) {
+            self->glx = 1;
+            XFree(vi);
+        }
 #endif
-    Py_INCREF(Py_False);
-    return Py_False;
+    }
+    return PyBool_FromLong(self->glx);
 }
 
 PyObject *
 X11Display_PyObject__composite_supported(X11Display_PyObject * self, PyObject * args)
 {
-#ifdef HAVE_X11_COMPOSITE
-    int event_base, error_base;
-    if ( XCompositeQueryExtension( self->display, &event_base, &error_base ) ) {
-    // If we get here the server supports the extension
-	int major = 0, minor = 2; // The highest version we support
+    X11Extension *ext;
 
-	XCompositeQueryVersion( self->display, &major, &minor );
-    
-	// major and minor will now contain the highest version the server supports.
-	// The protocol specifies that the returned version will never be higher
-	// then the one requested. Version 0.2 is the first version to have the
-	// XCompositeNameWindowPixmap() request.
-	if ( major > 0 || minor >= 2 ) {
-	    Py_INCREF(Py_True);
-	    return Py_True;
-	}
+    XLockDisplay(self->display);
+    ext = x11display_get_extension(self, X11_EXT_COMPOSITE);
+    XUnlockDisplay(self->display);
+
+    // Version 0.2 is the first version to have the XCompositeNameWindowPixmap()
+    // request.  Without the client library the version is never probed.
+    return PyBool_FromLong(ext->present && (ext->major > 0 || ext->minor >= 2));
+}
+
+PyObject *
+X11Display_PyObject__get_extensions(X11Display_PyObject * self, PyObject * args)
+{
+    PyObject *dict = PyDict_New(), *version;
+    X11Extension *ext;
+    int i;
+
+    XLockDisplay(self->display);
+    for (i = 0; i < X11_EXT_COUNT; i++) {
+        ext = x11display_get_extension(self, i);
+        if (!ext->present)
+            continue;
+        version = Py_BuildValue("(ii)", ext->major, ext->minor);
+        PyDict_SetItemString(dict, x11_extension_names[i], version);
+        Py_DECREF(version);
     }
-#endif    
-    Py_INCREF(Py_False);
-    return Py_False;
+    XUnlockDisplay(self->display);
+    return dict;
 }
 
 PyObject *
@@ -441,6 +701,7 @@ PyMethodDef X11Display_PyObject_methods[] = {
     { "glx_supported", ( PyCFunction ) X11Display_PyObject__glx_supported, METH_VARARGS },
     { "composite_supported", ( PyCFunction ) X11Display_PyObject__composite_supported, METH_VARARGS },
     { "composite_redirect", ( PyCFunction ) X11Display_PyObject__composite_redirect, METH_VARARGS },
+    { "get_extensions", ( PyCFunction ) X11Display_PyObject__get_extensions, METH_VARARGS },
     { "get_root_id", ( PyCFunction ) X11Display_PyObject__get_root_id, METH_VARARGS },
     { NULL, NULL }
 };
@@ -35,6 +35,21 @@
 #include <X11/Xlib.h>
 #include <glib.h>
 
+// Extensions whose availability is probed once per display.
+enum {
+    X11_EXT_COMPOSITE,
+    X11_EXT_RENDER,
+    X11_EXT_SHM,
+    X11_EXT_SHAPE,
+    X11_EXT_PRESENT,
+    X11_EXT_DAMAGE,
+    X11_EXT_COUNT
+};
+
+typedef struct {
+    int present, major, minor;
+} X11Extension;
+
 typedef struct {
     PyObject_HEAD
 
@@ -44,8 +59,36 @@ typedef struct {
              *error_callback;
     Atom wmDeleteMessage;
     int (*old_handler)(Display *, XErrorEvent *);
+    GHashTable *visual_formats;
+
+    // Server capabilities and shared resources, created on first use.
+    int probed;
+    X11Extension extensions[X11_EXT_COUNT];
+    int glx;
+    int argb_probed;
+    Visual *argb_visual;
+    Colormap argb_colormap;
+    Cursor invisible_cursor;
 } X11Display_PyObject;
 
+// How RGB colours map to pixel values for a given visual.
+typedef struct _X11VisualFormat {
+    Visual *visual;
+    Colormap colormap;
+    int depth;
+    // For TrueColor/DirectColor visuals pixels are computed from the masks;
+    // otherwise colours are allocated in the colormap and remembered.
+    int direct;
+    int red_shift, red_bits,
+        green_shift, green_bits,
+        blue_shift, blue_bits;
+    unsigned long alpha_mask;
+    GHashTable *pixels;
+    // Allocated colours belong to one colormap, so other colormaps with the
+    // same visual get their own format, chained here.
+    struct _X11VisualFormat *next;
+} X11VisualFormat;
+
 typedef struct {
     Display *display;
     int (*old_handler)(Display *, XErrorEvent *);
@@ -58,5 +101,10 @@ extern GHashTable *x11display_pyobjects;
 int x_error_handler(Display *, XErrorEvent *);
 void x_error_trap_push(void);
 int x_error_trap_pop(int do_raise);
+X11VisualFormat *x11display_get_visual_format(X11Display_PyObject *, Visual *, int depth, Colormap);
+X11Extension *x11display_get_extension(X11Display_PyObject *, int ext);
+Visual *x11display_get_argb_visual(X11Display_PyObject *, Colormap *colormap);
+Cursor x11display_get_invisible_cursor(X11Display_PyObject *);
+unsigned long x11display_color_to_pixel(X11Display_PyObject *, X11VisualFormat *, int r, int g, int b);
 
 #endif
@@ -0,0 +1,362 @@
+/*
+ * ----------------------------------------------------------------------------
+ * x11shape.c
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Jason Tackaberry <tack@sault.org>
+ * Maintainer:    Jason Tackaberry <tack@sault.org>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#include "config.h"
+#include <Python.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/extensions/shape.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "x11shape.h"
+
+#define BIT_SET(row, x) ((row)[(x) >> 3] & (1 << ((x) & 7)))
+
+
+/* Threshold one row of ARGB pixels into a packed 1-bit mask.  A pixel is
+ * visible when its alpha is >= threshold.  Padding bits in the last byte are
+ * always left cleared so packed rows can be compared with memcmp().
+ */
+static void
+_pack_alpha_row(const uint32_t *src, int width, int threshold, unsigned char *dst)
+{
+    int x = 0, i, n;
+    unsigned char byte;
+
+#ifdef __SSE2__
+    __m128i thresh = _mm_set1_epi32(threshold - 1);
+    for (; x + 16 <= width; x += 16) {
+        __m128i a0 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + x)), 24),
+                a1 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + x + 4)), 24),
+                a2 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + x + 8)), 24),
+                a3 = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)(src + x + 12)), 24);
+        // Compare results are 0 or -1, so saturating packs keep them intact
+        // and movemask then yields one bit per pixel in LSB-first order.
+        __m128i lo = _mm_packs_epi32(_mm_cmpgt_epi32(a0, thresh), _mm_cmpgt_epi32(a1, thresh)),
+                hi = _mm_packs_epi32(_mm_cmpgt_epi32(a2, thresh), _mm_cmpgt_epi32(a3, thresh));
+        unsigned int mask = _mm_movemask_epi8(_mm_packs_epi16(lo, hi));
+        dst[x >> 3] = mask & 0xff;
+        dst[(x >> 3) + 1] = mask >> 8;
+    }
+#endif
+    for (; x < width; x += 8) {
+        n = width - x < 8 ? width - x : 8;
+        for (i = 0, byte = 0; i < n; i++) {
+            if ((int)(src[x + i] >> 24) >= threshold)
+                byte |= 1 << i;
+        }
+        dst[x >> 3] = byte;
+    }
+}
+
+void
+x11shape_pack_alpha(const uint32_t *argb, int stride, int width, int height,
+                    int threshold, unsigned char *bits)
+{
+    int y, bpl = SHAPE_BYTES_PER_LINE(width);
+    for (y = 0; y < height; y++)
+        _pack_alpha_row(argb + y * stride, width, threshold, bits + y * bpl);
+}
+
+
+/* Pack a row of byte-per-pixel mask data, where any non-zero byte is a
+ * visible pixel.
+ */
+static void
+_pack_bytes_row(const unsigned char *src, int width, unsigned char *dst)
+{
+    int x = 0, i, n;
+    unsigned char byte;
+
+#ifdef __AVX2__
+    __m256i zero32 = _mm256_setzero_si256();
+    for (; x + 32 <= width; x += 32) {
+        uint32_t mask = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+                         _mm256_loadu_si256((const __m256i *)(src + x)), zero32));
+        memcpy(dst + (x >> 3), &mask, 4);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i zero = _mm_setzero_si128();
+    for (; x + 16 <= width; x += 16) {
+        unsigned int mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(
+                             _mm_loadu_si128((const __m128i *)(src + x)), zero));
+        dst[x >> 3] = mask & 0xff;
+        dst[(x >> 3) + 1] = (mask >> 8) & 0xff;
+    }
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    for (; x + 8 <= width; x += 8) {
+        uint64_t v;
+        memcpy(&v, src + x, 8);
+        // Set the high bit of every non-zero byte, then gather the eight
+        // high bits into the top byte with a single multiply.
+        v = (((v & 0x7f7f7f7f7f7f7f7fULL) + 0x7f7f7f7f7f7f7f7fULL) | v) & 0x8080808080808080ULL;
+        dst[x >> 3] = ((v >> 7) * 0x0102040810204080ULL) >> 56;
+    }
+#endif
+    for (; x < width; x += 8) {
+        n = width - x < 8 ? width - x : 8;
+        for (i = 0, byte = 0; i < n; i++) {
+            if (src[x + i])
+                byte |= 1 << i;
+        }
+        dst[x >> 3] = byte;
+    }
+}
+
+void
+x11shape_pack_bytes(const unsigned char *data, int stride, int width,
+                    int height, unsigned char *bits)
+{
+    int y, bpl = SHAPE_BYTES_PER_LINE(width);
+    for (y = 0; y < height; y++)
+        _pack_bytes_row(data + y * stride, width, bits + y * bpl);
+}
+
+
+/* Append one rectangle for each run of set bits in the given row.  Returns
+ * the new number of rectangles, or -1 if more than max_rects are needed.
+ */
+static int
+_row_to_rects(const unsigned char *row, int width, int y, XRectangle *rects,
+              int n_rects, int max_rects)
+{
+    int x = 0, start;
+
+    while (x < width) {
+        // Whole bytes of clear or set bits are skipped at once.
+        while (x < width && !BIT_SET(row, x))
+            x += ((x & 7) == 0 && row[x >> 3] == 0) ? 8 : 1;
+        if (x >= width)
+            break;
+        start = x;
+        while (x < width && BIT_SET(row, x))
+            x += ((x & 7) == 0 && row[x >> 3] == 0xff) ? 8 : 1;
+        if (x > width)
+            x = width;
+
+        if (n_rects >= max_rects)
+            return -1;
+        rects[n_rects].x = start;
+        rects[n_rects].y = y;
+        rects[n_rects].width = x - start;
+        rects[n_rects].height = 1;
+        n_rects++;
+    }
+    return n_rects;
+}
+
+/* Run-length encode a packed mask into YX-banded rectangles.  Consecutive
+ * identical rows extend the previous band rather than starting a new one.
+ * Returns NULL if the mask needs more than max_rects rectangles, in which case
+ * the caller is better off sending the bitmap.
+ */
+XRectangle *
+x11shape_bits_to_rects(const unsigned char *bits, int width, int height,
+                       int max_rects, int *n_rects)
+{
+    int bpl = SHAPE_BYTES_PER_LINE(width), y, i, n = 0, band_start = 0;
+    const unsigned char *row, *prev = NULL;
+    XRectangle *rects;
+
+    rects = malloc(sizeof(XRectangle) * (max_rects > 0 ? max_rects : 1));
+    if (!rects)
+        return NULL;
+
+    for (y = 0; y < height; y++) {
+        row = bits + y * bpl;
+        if (prev && !memcmp(row, prev, bpl)) {
+            for (i = band_start; i < n; i++)
+                rects[i].height++;
+            continue;
+        }
+        band_start = n;
+        n = _row_to_rects(row, width, y, rects, n, max_rects);
+        if (n < 0) {
+            free(rects);
+            return NULL;
+        }
+        prev = row;
+    }
+    *n_rects = n;
+    return rects;
+}
+
+
+static void
+_remember(X11Window_PyObject *win, unsigned char *bits,
+          int x, int y, int width, int height)
+{
+    free(win->shape_bits);
+    win->shape_bits = bits;
+    win->shape_x = x;
+    win->shape_y = y;
+    win->shape_w = width;
+    win->shape_h = height;
+}
+
+/* Size of a mask as PutImage sends it, with scanlines padded to 32 bits.
+ * Rectangle lists that would be larger than this are not worth sending.
+ */
+static int
+_bitmap_size(int width, int height)
+{
+    return ((width + 31) / 32) * 4 * height;
+}
+
+static int
+_same_geometry(X11Window_PyObject *win, int x, int y, int width, int height)
+{
+    return win->shape_bits && win->shape_x == x && win->shape_y == y &&
+           win->shape_w == width && win->shape_h == height;
+}
+
+/* Set the bounding shape of the window from a packed mask, choosing whichever
+ * of a rectangle list or a bitmap is cheaper to send.  Nothing is sent if the
+ * mask is identical to the one last applied.  Ownership of bits passes to
+ * this function.  Returns 1 if the shape was changed, 0 otherwise.
+ *
+ * The display must be locked by the caller.
+ */
+int
+x11shape_apply(X11Window_PyObject *win, unsigned char *bits,
+               int x, int y, int width, int height)
+{
+    int n_rects;
+    XRectangle *rects;
+    Pixmap pix;
+
+    if (_same_geometry(win, x, y, width, height) &&
+        !memcmp(win->shape_bits, bits, SHAPE_BYTES_PER_LINE(width) * height)) {
+        free(bits);
+        return 0;
+    }
+
+    rects = x11shape_bits_to_rects(bits, width, height,
+                                   _bitmap_size(width, height) / sizeof(XRectangle),
+                                   &n_rects);
+    if (rects) {
+        XShapeCombineRectangles(win->display, win->window, ShapeBounding, x, y,
+                                rects, n_rects, ShapeSet, YXBanded);
+        free(rects);
+    } else {
+        pix = XCreateBitmapFromData(win->display, win->window, (char *)bits,
+                                    width, height);
+        if (pix != None) {
+            XShapeCombineMask(win->display, win->window, ShapeBounding, x, y,
+                              pix, ShapeSet);
+            XFreePixmap(win->display, pix);
+        }
+    }
+
+    _remember(win, bits, x, y, width, height);
+    return 1;
+}
+
+/* Like x11shape_apply(), but if a mask of the same geometry was applied
+ * before, only the rows that differ from it are sent: they are cut out of
+ * the current shape with ShapeSubtract and their visible runs are added back
+ * with ShapeUnion.  Falls back to a full update if the delta would be more
+ * expensive than resending the whole mask.
+ */
+int
+x11shape_apply_incremental(X11Window_PyObject *win, unsigned char *bits,
+                           int x, int y, int width, int height)
+{
+    int bpl = SHAPE_BYTES_PER_LINE(width), max_rects, n_sub = 0, n_add = 0, row;
+    XRectangle *sub, *add;
+
+    if (!_same_geometry(win, x, y, width, height))
+        return x11shape_apply(win, bits, x, y, width, height);
+
+    max_rects = _bitmap_size(width, height) / sizeof(XRectangle);
+    sub = malloc(sizeof(XRectangle) * (height > 0 ? height : 1));
+    add = malloc(sizeof(XRectangle) * (max_rects > 0 ? max_rects : 1));
+    if (!sub || !add)
+        goto full;
+
+    for (row = 0; row < height; row++) {
+        if (!memcmp(win->shape_bits + row * bpl, bits + row * bpl, bpl))
+            continue;
+        // Adjacent changed rows share one subtracted band.
+        if (n_sub && sub[n_sub - 1].y + sub[n_sub - 1].height == row)
+            sub[n_sub - 1].height++;
+        else {
+            sub[n_sub].x = 0;
+            sub[n_sub].y = row;
+            sub[n_sub].width = width;
+            sub[n_sub].height = 1;
+            n_sub++;
+        }
+        n_add = _row_to_rects(bits + row * bpl, width, row, add, n_add, max_rects);
+        if (n_add < 0 || n_sub + n_add > max_rects)
+            goto full;
+    }
+
+    if (n_sub == 0) {
+        free(sub);
+        free(add);
+        free(bits);
+        return 0;
+    }
+
+    XShapeCombineRectangles(win->display, win->window, ShapeBounding, x, y,
+                            sub, n_sub, ShapeSubtract, YXBanded);
+    if (n_add)
+        XShapeCombineRectangles(win->display, win->window, ShapeBounding, x, y,
+                                add, n_add, ShapeUnion, YXBanded);
+    free(sub);
+    free(add);
+    _remember(win, bits, x, y, width, height);
+    return 1;
+
+full:
+    free(sub);
+    free(add);
+    x11shape_clear(win);
+    return x11shape_apply(win, bits, x, y, width, height);
+}
+
+/* Forget the last applied mask, e.g. because the shape was reset or set
+ * through some other path.
+ */
+void
+x11shape_clear(X11Window_PyObject *win)
+{
+    free(win->shape_bits);
+    win->shape_bits = NULL;
+}
@@ -0,0 +1,56 @@
+/*
+ * ----------------------------------------------------------------------------
+ * x11shape.h
+ * ----------------------------------------------------------------------------
+ * $Id$
+ *
+ * ----------------------------------------------------------------------------
+ * kaa.display - Generic Display Module
+ * Copyright (C) 2005, 2006 Dirk Meyer, Jason Tackaberry
+ *
+ * First Edition: Jason Tackaberry <tack@sault.org>
+ * Maintainer:    Jason Tackaberry <tack@sault.org>
+ *
+ * Please see the file AUTHORS for a complete list of authors.
+ *
+ * This library is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version
+ * 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifndef _X11SHAPE_H_
+#define _X11SHAPE_H_
+
+#include <X11/Xlib.h>
+#include <stdint.h>
+#include "x11window.h"
+
+// Shape masks are packed LSB first with each row padded to a full byte,
+// which is the layout XCreateBitmapFromData() expects.
+#define SHAPE_BYTES_PER_LINE(w) (((w) + 7) / 8)
+
+void x11shape_pack_alpha(const uint32_t *argb, int stride, int width,
+                         int height, int threshold, unsigned char *bits);
+void x11shape_pack_bytes(const unsigned char *data, int stride, int width,
+                         int height, unsigned char *bits);
+XRectangle *x11shape_bits_to_rects(const unsigned char *bits, int width,
+                                   int height, int max_rects, int *n_rects);
+int x11shape_apply(X11Window_PyObject *win, unsigned char *bits,
+                   int x, int y, int width, int height);
+int x11shape_apply_incremental(X11Window_PyObject *win, unsigned char *bits,
+                               int x, int y, int width, int height);
+void x11shape_clear(X11Window_PyObject *win);
+
+#endif
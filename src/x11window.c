@@ -33,10 +33,10 @@
 #include <Python.h>
 #include "x11window.h"
 #include "x11display.h"
+#include "x11shape.h"
+#include "colorlut.h"
 #include "structmember.h"
 
-void _make_invisible_cursor(X11Window_PyObject *win);
-Visual *find_argb_visual (Display *dpy, int scr);
 
 int _ewmh_set_hint(X11Window_PyObject *o, char *type, long *data, int ndata)
 {
@@ -89,9 +89,9 @@ X11Window_PyObject__new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
     X11Window_PyObject *self, *py_parent;
     X11Display_PyObject *display;
     Window parent;
-    Window root;
     Visual *visual;    
-    int w, h, screen, argb=0, depth, window_events=1, mouse_events=1, key_events=1, input_only=0;
+    int w, h, screen, argb=0, depth, window_events=1, mouse_events=1, key_events=1, input_only=0,
+        override_redirect=0;
     long evmask = 0;
     char *window_title = NULL;
     XSetWindowAttributes attr;
@@ -124,6 +124,9 @@ X11Window_PyObject__new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
     if (PyMapping_HasKeyString(kwargs, "input_only"))
         input_only = PyInt_AsLong(PyDict_GetItemString(kwargs, "input_only"));
 
+    if (PyMapping_HasKeyString(kwargs, "override_redirect"))
+        override_redirect = PyInt_AsLong(PyDict_GetItemString(kwargs, "override_redirect"));
+
     self->display_pyobject = (PyObject *)display;
     self->display = display->display;
 
@@ -165,17 +168,17 @@ X11Window_PyObject__new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
         self->owner = Py_False;
     } else {
         screen = DefaultScreen(self->display);
-#ifdef HAVE_X11_COMPOSITE        
         if (argb == 1)
         {
             depth = 32;
-            root = RootWindow(self->display, screen);
-            visual = find_argb_visual(self->display, screen);
-            attr.colormap = XCreateColormap (self->display, root, visual, AllocNone);
-            wmask = CWEventMask | CWBackPixel | CWBorderPixel | CWColormap;
+            visual = x11display_get_argb_visual(display, &attr.colormap);
+            if (!visual) {
+                PyErr_Format(PyExc_SystemError, "No ARGB visual available");
+                goto fail;
+            }
+            wmask = CWEventMask | CWBackPixel | CWBorderPixel | CWColormap | CWOverrideRedirect;
         }
         else
-#endif  
         {
             depth = DefaultDepth(self->display, screen);
             visual = DefaultVisual(self->display, screen);
@@ -190,14 +193,14 @@ X11Window_PyObject__new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
         attr.event_mask = evmask;
         attr.bit_gravity = StaticGravity;
         attr.win_gravity = StaticGravity;
-        attr.override_redirect = False;
+        attr.override_redirect = override_redirect ? True : False;
 
         x_error_trap_push();
         if (input_only){
                 attr.event_mask = evmask & ~ExposureMask;
                 self->window = XCreateWindow(self->display, parent, 0, 0,
                                 w, h, 0, 0, InputOnly, NULL,
-                                CWWinGravity | CWEventMask, &attr);
+                                CWWinGravity | CWEventMask | CWOverrideRedirect, &attr);
         } else {
                 self->window = XCreateWindow(self->display, parent, 0, 0,
                                 w, h, 0, depth, InputOutput, visual,
@@ -248,11 +251,13 @@ X11Window_PyObject__dealloc(X11Window_PyObject * self)
         if (self->owner == Py_True)
             XDestroyWindow(self->display, self->window);
         Py_XDECREF(self->wid);
-        if (self->invisible_cursor)
-            XFreeCursor(self->display, self->invisible_cursor);
+        if (self->gc)
+            XFreeGC(self->display, self->gc);
         XUnlockDisplay(self->display);
         x_error_trap_pop(False);
     }
+    x11shape_clear(self);
+    free(self->lut);
     Py_DECREF(self->owner);
     Py_XDECREF(self->display_pyobject);
     X11Window_PyObject__clear(self);
@@ -328,6 +333,55 @@ X11Window_PyObject__set_geometry(X11Window_PyObject * self, PyObject * args)
     return Py_INCREF(Py_None), Py_None;
 }
 
+/* Move, resize and map the window in one go.  Unlike set_geometry() and
+ * show() this doesn't wait for the server, so a window that was created
+ * ahead of time appears with a single round of requests.
+ */
+PyObject *
+X11Window_PyObject__configure_and_map(X11Window_PyObject * self, PyObject * args)
+{
+    int x, y, raise;
+    unsigned int w, h;
+    if (!PyArg_ParseTuple(args, "(ii)(ii)i", &x, &y, &w, &h, &raise))
+        return NULL;
+
+    XLockDisplay(self->display);
+    XMoveResizeWindow(self->display, self->window, x, y, w, h);
+    if (raise)
+        XMapRaised(self->display, self->window);
+    else
+        XMapWindow(self->display, self->window);
+    XFlush(self->display);
+    XUnlockDisplay(self->display);
+    return Py_INCREF(Py_None), Py_None;
+}
+
+/* Unmap the window and undo per-use state (shape mask, hidden cursor,
+ * title, transient-for and decorations) so it can be handed out again.  It
+ * is stacked on top, as a new window would be.
+ */
+PyObject *
+X11Window_PyObject__reset(X11Window_PyObject * self, PyObject * args)
+{
+    XLockDisplay(self->display);
+    XUnmapWindow(self->display, self->window);
+    XShapeCombineMask(self->display, self->window, ShapeBounding, 0, 0, None, ShapeSet);
+    x11shape_clear(self);
+    XUndefineCursor(self->display, self->window);
+    XDeleteProperty(self->display, self->window, XA_WM_TRANSIENT_FOR);
+    XDeleteProperty(self->display, self->window, XA_WM_NAME);
+    XDeleteProperty(self->display, self->window,
+                    XInternAtom(self->display, "_NET_WM_NAME", False));
+    XDeleteProperty(self->display, self->window,
+                    XInternAtom(self->display, "_NET_WM_WINDOW_TYPE", False));
+    XRaiseWindow(self->display, self->window);
+    XFlush(self->display);
+    XUnlockDisplay(self->display);
+    free(self->lut);
+    self->lut = NULL;
+    return Py_INCREF(Py_None), Py_None;
+}
+
 PyObject *
 X11Window_PyObject__set_cursor_visible(X11Window_PyObject *self, PyObject *args)
 {
@@ -336,11 +390,10 @@ X11Window_PyObject__set_cursor_visible(X11Window_PyObject *self, PyObject *args)
         return NULL;
 
     XLockDisplay(self->display);
-    if (!visible) {
-        if (!self->invisible_cursor)
-            _make_invisible_cursor(self);
-        XDefineCursor(self->display, self->window, self->invisible_cursor);
-    } else
+    if (!visible)
+        XDefineCursor(self->display, self->window,
+                      x11display_get_invisible_cursor((X11Display_PyObject *)self->display_pyobject));
+    else
         XUndefineCursor(self->display, self->window);
     XUnlockDisplay(self->display);
 
@@ -622,50 +675,46 @@ X11Window_PyObject__get_properties(X11Window_PyObject * self, PyObject * args)
 PyObject *
 X11Window_PyObject__set_shape_mask(X11Window_PyObject * self, PyObject * args)
 {
-    const char *data;
-    Pixmap pix;
-    int allocated_bit_buffer = 0, len, x, y, width, height;
-    
-    
-    if (!PyArg_ParseTuple(args, "s#(ii)(ii)", &data, &len, &x, &y, &width, &height))
+    Py_buffer mask;
+    unsigned char *bits;
+    int x, y, width, height, bpl, incremental = 0, changed;
+
+    if (!PyArg_ParseTuple(args, "s*(ii)(ii)|i", &mask, &x, &y, &width, &height, &incremental))
         return NULL;
-    
-    if ((width * height) == len) {
-        int bit_count = 0, data_pos = 0, bit_buffer_pos = 0;
-        char *bit_buffer = malloc( ((width * height) + 7) / 8);
 
-        if (bit_buffer == NULL) {
-            return NULL;
-        }
-        
-        for (data_pos = 0; data_pos < len; data_pos ++) {
-            bit_buffer[bit_buffer_pos] |= data[data_pos] << bit_count;
-            bit_count ++;
-            if (bit_count == 8) {
-                bit_count = 0;
-                bit_buffer_pos ++;
-                bit_buffer[bit_buffer_pos] = 0;
-            }
-        }        
-        data = bit_buffer;
-        allocated_bit_buffer = 1;
+    if (width <= 0 || height <= 0) {
+        PyBuffer_Release(&mask);
+        PyErr_SetString(PyExc_ValueError, "Invalid mask size");
+        return NULL;
     }
-    
-    XLockDisplay(self->display);
-    // Construct a bitmap from the supplied data for passing to the XShape extension
-    pix = XCreateBitmapFromData(self->display, self->window, data, width, height);
-    if (pix != None) {
-        XShapeCombineMask(self->display, self->window, ShapeBounding, x, y, pix, ShapeSet);
-        XFreePixmap(self->display, pix);
+
+    bpl = SHAPE_BYTES_PER_LINE(width);
+    if (mask.len != width * height && mask.len != bpl * height) {
+        PyBuffer_Release(&mask);
+        PyErr_SetString(PyExc_ValueError, "Mask is wrong length");
+        return NULL;
     }
-    XUnlockDisplay(self->display);
-    
-    if (allocated_bit_buffer) {
-        free((void*)data);
+
+    bits = malloc(bpl * height);
+    if (!bits) {
+        PyBuffer_Release(&mask);
+        return PyErr_NoMemory();
     }
-    
-    Py_INCREF(Py_None);
-    return Py_None;
+    if (mask.len == width * height && width * height != bpl * height)
+        // One byte per pixel
+        x11shape_pack_bytes(mask.buf, width, width, height, bits);
+    else
+        memcpy(bits, mask.buf, bpl * height);
+    PyBuffer_Release(&mask);
+
+    XLockDisplay(self->display);
+    if (incremental)
+        changed = x11shape_apply_incremental(self, bits, x, y, width, height);
+    else
+        changed = x11shape_apply(self, bits, x, y, width, height);
+    XUnlockDisplay(self->display);
+
+    return PyBool_FromLong(changed);
 }
 
 PyObject *
@@ -673,6 +722,7 @@ X11Window_PyObject__reset_shape_mask(X11Window_PyObject * self, PyObject * args)
 {
     XLockDisplay(self->display);
     XShapeCombineMask(self->display, self->window, ShapeBounding, 0, 0, None, ShapeSet);
+    x11shape_clear(self);
     XUnlockDisplay(self->display);
     Py_INCREF(Py_None);
     return Py_None;
@@ -711,39 +761,193 @@ X11Window_PyObject__set_decorated(X11Window_PyObject * self, PyObject * args)
     return Py_None;
 }
 
+/* Return the window's GC with its foreground set to the given pixel.  The GC
+ * is created once and kept for the lifetime of the window.  The display must
+ * be locked by the caller.
+ */
+static GC
+_get_gc(X11Window_PyObject *self, unsigned long pixel)
+{
+    if (!self->gc) {
+        self->gc = XCreateGC(self->display, self->window, 0, 0);
+        XSetForeground(self->display, self->gc, pixel);
+        self->gc_foreground = pixel;
+    } else if (self->gc_foreground != pixel) {
+        XSetForeground(self->display, self->gc, pixel);
+        self->gc_foreground = pixel;
+    }
+    return self->gc;
+}
+
+/* Return the colour layout of the window's visual.  Looked up once per
+ * window; the layout itself is shared by all windows of the display with the
+ * same visual.  The display must be locked by the caller.
+ */
+static X11VisualFormat *
+_get_visual_format(X11Window_PyObject *self)
+{
+    XWindowAttributes attrs;
+
+    if (!self->format) {
+        XGetWindowAttributes(self->display, self->window, &attrs);
+        self->format = x11display_get_visual_format((X11Display_PyObject *)self->display_pyobject,
+                                                    attrs.visual, attrs.depth, attrs.colormap);
+    }
+    return self->format;
+}
+
 PyObject *
 X11Window_PyObject__draw_rectangle(X11Window_PyObject * self, PyObject * args)
 {
-    int x, y, width, height;
-    unsigned long color;
-    int depth, r, g, b;
+    int x, y, width, height, r, g, b;
+    unsigned long pixel;
     GC gc;
 
     if (!PyArg_ParseTuple(args, "(ii)(ii)(iii)", &x, &y, &width, &height, &r, &g, &b))
         return NULL;
  
     XLockDisplay(self->display);
-    depth = DefaultDepth(self->display, DefaultScreen(self->display));
-    if (depth == 16)
-        color = ((r & 248) << 8) + ((g & 252) << 3) + ((b & 248) >> 3);
-    else
-        color = (r << 16) + (g << 8) + b;
-    gc = XCreateGC(self->display, self->window, 0, 0);
-    XSetForeground(self->display, gc, color);
+    pixel = x11display_color_to_pixel((X11Display_PyObject *)self->display_pyobject,
+                                      _get_visual_format(self), r, g, b);
+    gc = _get_gc(self, pixel);
     XFillRectangle(self->display, self->window, gc, x, y, width, height);
-    XFreeGC(self->display, gc);
     XUnlockDisplay(self->display);
 
     Py_INCREF(Py_None);
     return Py_None;
 }
 
+typedef struct {
+    unsigned long pixel;
+    int index;
+    XRectangle rect;
+} _ColoredRect;
+
+/* Clip the span from v of the given length to the coordinates XRectangle
+ * can hold.  Returns the new length, 0 or less if nothing is left.
+ */
+static int
+_clip_span(int *v, int length)
+{
+    long long start = *v, end = (long long)*v + length;
+
+    if (start < SHRT_MIN)
+        start = SHRT_MIN;
+    if (end > SHRT_MAX)
+        end = SHRT_MAX;
+    *v = start;
+    return end - start > USHRT_MAX ? USHRT_MAX : end - start;
+}
+
+static int
+_colored_rect_cmp(const void *a, const void *b)
+{
+    const _ColoredRect *ra = a, *rb = b;
+    if (ra->pixel != rb->pixel)
+        return ra->pixel < rb->pixel ? -1 : 1;
+    return ra->index - rb->index;
+}
+
+PyObject *
+X11Window_PyObject__fill_rectangles(X11Window_PyObject * self, PyObject * args)
+{
+    PyObject *pyrects, *seq;
+    _ColoredRect *crects;
+    XRectangle *rects;
+    X11VisualFormat *format;
+    int *colors, n, m, i, start, x, y, width, height;
+
+    if (!PyArg_ParseTuple(args, "O", &pyrects))
+        return NULL;
+
+    seq = PySequence_Fast(pyrects, "rectangles must be a sequence");
+    if (!seq)
+        return NULL;
+
+    n = PySequence_Fast_GET_SIZE(seq);
+    crects = malloc(sizeof(_ColoredRect) * (n ? n : 1));
+    rects = malloc(sizeof(XRectangle) * (n ? n : 1));
+    colors = malloc(sizeof(int) * 3 * (n ? n : 1));
+    if (!crects || !rects || !colors) {
+        PyErr_NoMemory();
+        goto fail;
+    }
+
+    // Empty rectangles, e.g. of an empty progress bar, are skipped.
+    for (i = m = 0; i < n; i++) {
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(seq, i), "(ii)(ii)(iii)",
+                              &x, &y, &width, &height,
+                              &colors[m * 3], &colors[m * 3 + 1], &colors[m * 3 + 2]))
+            goto fail;
+        if (width <= 0 || height <= 0)
+            continue;
+        width = _clip_span(&x, width);
+        height = _clip_span(&y, height);
+        if (width <= 0 || height <= 0)
+            continue;
+        crects[m].index = m;
+        crects[m].rect.x = x;
+        crects[m].rect.y = y;
+        crects[m].rect.width = width;
+        crects[m].rect.height = height;
+        m++;
+    }
+    n = m;
+
+    XLockDisplay(self->display);
+    format = _get_visual_format(self);
+    for (i = 0; i < n; i++)
+        crects[i].pixel = x11display_color_to_pixel((X11Display_PyObject *)self->display_pyobject,
+                                                    format, colors[i * 3], colors[i * 3 + 1],
+                                                    colors[i * 3 + 2]);
+
+    // Group by colour so each colour costs one XFillRectangles request.
+    qsort(crects, n, sizeof(_ColoredRect), _colored_rect_cmp);
+    for (start = 0; start < n; start = i) {
+        for (i = start; i < n && crects[i].pixel == crects[start].pixel; i++)
+            rects[i - start] = crects[i].rect;
+        XFillRectangles(self->display, self->window, _get_gc(self, crects[start].pixel),
+                        rects, i - start);
+    }
+    XUnlockDisplay(self->display);
+
+    free(crects);
+    free(rects);
+    free(colors);
+    Py_DECREF(seq);
+    Py_INCREF(Py_None);
+    return Py_None;
+
+fail:
+    free(crects);
+    free(rects);
+    free(colors);
+    Py_DECREF(seq);
+    return NULL;
+}
+
+/* Colour table for images rendered into this window, see colorlut.c */
+PyObject *
+X11Window_PyObject__set_color_lut(X11Window_PyObject * self, PyObject * args)
+{
+    PyObject *lut;
+
+    if (!PyArg_ParseTuple(args, "O", &lut))
+        return NULL;
+    if (colorlut_from_pyobject(lut, &self->lut) < 0)
+        return NULL;
+    Py_INCREF(Py_None);
+    return Py_None;
+}
+
 PyMethodDef X11Window_PyObject_methods[] = {
     { "show", (PyCFunction)X11Window_PyObject__show, METH_VARARGS },
     { "hide", (PyCFunction)X11Window_PyObject__hide, METH_VARARGS },
     { "raise_", (PyCFunction)X11Window_PyObject__raise, METH_VARARGS },
     { "lower", (PyCFunction)X11Window_PyObject__lower, METH_VARARGS },
     { "set_geometry", (PyCFunction)X11Window_PyObject__set_geometry, METH_VARARGS },
+    { "configure_and_map", (PyCFunction)X11Window_PyObject__configure_and_map, METH_VARARGS },
+    { "reset", (PyCFunction)X11Window_PyObject__reset, METH_VARARGS },
     { "get_geometry", (PyCFunction)X11Window_PyObject__get_geometry, METH_VARARGS },
     { "set_cursor_visible", (PyCFunction)X11Window_PyObject__set_cursor_visible, METH_VARARGS },
     { "set_fullscreen", (PyCFunction)X11Window_PyObject__set_fullscreen, METH_VARARGS },
@@ -759,6 +963,8 @@ PyMethodDef X11Window_PyObject_methods[] = {
     { "reset_shape_mask", (PyCFunction)X11Window_PyObject__reset_shape_mask, METH_VARARGS },
     { "set_decorated", (PyCFunction)X11Window_PyObject__set_decorated, METH_VARARGS },
     { "draw_rectangle", (PyCFunction)X11Window_PyObject__draw_rectangle, METH_VARARGS },
+    { "fill_rectangles", (PyCFunction)X11Window_PyObject__fill_rectangles, METH_VARARGS },
+    { "set_color_lut", (PyCFunction)X11Window_PyObject__set_color_lut, METH_VARARGS },
     { NULL, NULL }
 };
 
@@ -776,28 +982,9 @@ X11Window_PyObject__wrap(PyObject *display, Window window)
     o->display = ((X11Display_PyObject *)display)->display;
     o->window = window;
     o->wid = PyLong_FromUnsignedLong(window);
-    XLockDisplay(o->display);
-    _make_invisible_cursor(o);
-    XUnlockDisplay(o->display);
     return o;
 }
 
-void
-_make_invisible_cursor(X11Window_PyObject *win)
-{
-    Pixmap pix;
-    static char bits[] = {0, 0, 0, 0, 0, 0, 0};
-    XColor cfg;
-
-    // Construct an invisible cursor for mouse hiding.
-    cfg.red = cfg.green = cfg.blue = 0;
-    pix = XCreateBitmapFromData(win->display, win->window, bits, 1, 1);
-    // Memory leak in Xlib: https://bugs.freedesktop.org/show_bug.cgi?id=3568
-    win->invisible_cursor = XCreatePixmapCursor(win->display, pix, pix, &cfg,
-                                                &cfg, 0, 0);
-    XFreePixmap(win->display, pix);
-}
-
 // Exported _C_API function
 int x11window_object_decompose(X11Window_PyObject *win, Window *window, Display **display)
 {
@@ -812,45 +999,6 @@ int x11window_object_decompose(X11Window_PyObject *win, Window *window, Display
     return 1;
 }
 
-#ifdef HAVE_X11_COMPOSITE
-
-Visual *find_argb_visual (Display *dpy, int scr)
-{
-    XVisualInfo		*xvi;
-    XVisualInfo		template;
-    int			nvi;
-    int			i;
-    XRenderPictFormat	*format;
-    Visual		*visual;
-
-    template.screen = scr;
-    template.depth = 32;
-    template.class = TrueColor;
-    xvi = XGetVisualInfo (dpy, 
-			  VisualScreenMask |
-			  VisualDepthMask |
-			  VisualClassMask,
-			  &template,
-			  &nvi);
-    if (!xvi)
-        return 0;
-    
-    visual = 0;
-    for (i = 0; i < nvi; i++)
-    {
-        format = XRenderFindVisualFormat (dpy, xvi[i].visual);
-        if (format->type == PictTypeDirect && format->direct.alphaMask)
-        {
-            visual = xvi[i].visual;
-            break;
-        }
-    }
-
-    XFree (xvi);
-    return visual;
-}
-#endif
-
 static PyMemberDef X11Window_PyObject_members[] = {
     {"wid", T_OBJECT_EX, offsetof(X11Window_PyObject, wid), 0, ""},
     {"owner", T_OBJECT_EX, offsetof(X11Window_PyObject, owner), 0, ""},
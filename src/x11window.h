@@ -42,16 +42,29 @@
 
 #define X11Window_PyObject_Check(v) ((v)->ob_type == &X11Window_PyObject_Type)
 
+struct _X11VisualFormat;
+
 typedef struct {
     PyObject_HEAD
 
     PyObject *display_pyobject;
     Display *display;
     Window   window;
-    Cursor   invisible_cursor;
 
     PyObject *wid,
              *owner;
+
+    // Last shape mask applied, packed 1 bit per pixel (see x11shape.c)
+    unsigned char *shape_bits;
+    int shape_x, shape_y, shape_w, shape_h;
+
+    // Drawing state for draw_rectangle/fill_rectangles, created on first use
+    GC gc;
+    unsigned long gc_foreground;
+    struct _X11VisualFormat *format;
+
+    // Colour table applied by render_imlib2_image, NULL for none
+    struct _ColorLUT *lut;
 } X11Window_PyObject;
 
 extern PyTypeObject X11Window_PyObject_Type;
@@ -0,0 +1,41 @@
+# -*- coding: iso-8859-1 -*-
+# Measure framebuffer captures on a fake (file backed) framebuffer while a
+# small box moves over the screen, as for remote monitoring at 10 Hz.
+#
+# usage: python fb_capture.py [width height [file]]
+
+import sys
+import time
+import struct
+
+import kaa.imlib2
+from kaa.display import _FBmodule
+
+FRAMES = 100
+
+size = 1920, 1080
+device = None
+if len(sys.argv) > 2:
+    size = int(sys.argv[1]), int(sys.argv[2])
+if len(sys.argv) > 3:
+    device = sys.argv[3]
+
+fb = _FBmodule.Framebuffer(device, fake=size, depth=32)
+image = kaa.imlib2.new(size)
+fb.update(image._image)
+full = len(fb.capture(None, True))
+
+total = 0
+t0 = time.time()
+for i in range(FRAMES):
+    image.clear()
+    image.draw_rectangle((i * 8 % size[0], 100), (100, 100), (0xff, 0, 0, 0xff), fill=True)
+    fb.update(image._image)
+    total += len(fb.capture())
+t = time.time() - t0
+
+width, height, bpp, tile, n = struct.unpack('<5H', fb.capture(None, True)[:10])
+print '%dx%d, %d bytes per pixel, %dx%d tiles' % (width, height, bpp, tile, tile)
+print 'full capture %d bytes, delta %d bytes per frame' % (full, total / FRAMES)
+print '%.2f ms per frame including drawing and update' % (t * 1000 / FRAMES)
+fb.close()
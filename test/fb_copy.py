@@ -0,0 +1,41 @@
+# -*- coding: iso-8859-1 -*-
+# Compare the framebuffer copy engines on a fake (file backed) framebuffer.
+#
+# usage: python fb_copy.py [width height [file]]
+# Without a file the framebuffer lives in anonymous memory.  Use a file on
+# a tmpfs or the real device node to measure something closer to hardware.
+
+import sys
+import time
+
+import kaa.imlib2
+from kaa.display import _FBmodule
+
+FRAMES = 200
+
+size = 1920, 1080
+device = None
+if len(sys.argv) > 2:
+    size = int(sys.argv[1]), int(sys.argv[2])
+if len(sys.argv) > 3:
+    device = sys.argv[3]
+
+fb = _FBmodule.Framebuffer(device, fake=size, depth=32)
+image = kaa.imlib2.new(size)
+image.draw_rectangle((0, 0), size, (0x20, 0x40, 0x80, 0xff), fill=True)
+
+engines, default = _FBmodule.get_copy_engines()
+print '%dx%d, %d frames, default engine %s' % (size[0], size[1], FRAMES, default or 'per device')
+
+for engine in engines:
+    _FBmodule.set_copy_engine(engine)
+    fb.update(image._image)
+    t0 = time.time()
+    for i in range(FRAMES):
+        fb.update(image._image)
+    t = time.time() - t0
+    mb = size[0] * size[1] * 4 * FRAMES / t / 1024 / 1024
+    print '%-8s %6.2f ms/frame %8.1f MB/s' % (engine, t * 1000 / FRAMES, mb)
+
+_FBmodule.set_copy_engine(default)
+fb.close()
@@ -0,0 +1,36 @@
+# -*- coding: iso-8859-1 -*-
+# Print the key and button events of evdev devices as the framebuffer
+# emits them.
+#
+# usage: python fb_input.py [device ...]
+# Without devices all /dev/input/event* are read.  A file or pipe with
+# recorded input_event structs can be given instead of a device, e.g.
+# python fb_input.py /tmp/events  after  cat /dev/input/event0 > /tmp/events
+
+import sys
+
+import kaa
+import kaa.display
+
+def key_pressed(key):
+    print 'Key Press:', repr(key)
+    if key in ('esc', 'q', 'Q'):
+        kaa.main.stop()
+
+def key_released(key):
+    print 'Key Release:', repr(key)
+
+def button_pressed(pos, state, button):
+    print 'Button Press:', pos, state, button
+
+def button_released(pos, state, button):
+    print 'Button Release:', pos, state, button
+
+fb = kaa.display.Framebuffer(fake=(800, 600), input=sys.argv[1:] or ['/dev/input/event*'])
+fb.signals['key_press_event'].connect(key_pressed)
+fb.signals['key_release_event'].connect(key_released)
+fb.signals['button_press_event'].connect(button_pressed)
+fb.signals['button_release_event'].connect(button_released)
+
+print 'Framebuffer input test, use the Esc or q key to quit'
+kaa.main.run()